@@ -0,0 +1,394 @@
+// Throughput of the loader, the parser and lookups over synthetic corpora, see corpus.h
+//
+//     ini_bench [--size MB] [--reps N] [--corpus NAME] [--seed N]
+//     ini_bench --write DIR [--size MB] [--corpus NAME] [--seed N]
+//     ini_bench --save-baseline FILE [options]
+//     ini_bench --baseline FILE [--threshold PERCENT] [options]
+//
+// Every stage runs reps times and the best run is reported, as MB/s of .ini text, ns per property (per
+// lookup for ini_get) and heap allocations per run. --write only generates the corpora into DIR.
+// --save-baseline stores every stage's best time in FILE, --baseline compares against one stored with the same
+// --size and --seed and exits with 1 if any stage got more than --threshold percent (default 10) slower.
+
+#include "ini_parser.h"
+#include "corpus.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+// Allocation counting interposes the C heap, which only glibc lets us forward to the real thing
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+#define BENCH_COUNT_ALLOCS 1
+
+static std::atomic<uint64_t> heap_allocations(0);
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *p, size_t size);
+void __libc_free(void *p);
+
+void *malloc(size_t size) noexcept
+{
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) noexcept
+{
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *p, size_t size) noexcept
+{
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(p, size);
+}
+
+void free(void *p) noexcept
+{
+    __libc_free(p);
+}
+}
+#endif
+
+static uint64_t allocation_count()
+{
+#ifdef BENCH_COUNT_ALLOCS
+    return heap_allocations.load(std::memory_order_relaxed);
+#else
+    return 0;
+#endif
+}
+
+static double now_ns()
+{
+    using namespace std::chrono;
+    return (double)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Best of reps runs of one stage
+struct stage_result {
+    double ns;                      // fastest run
+    uint64_t allocations;           // heap allocations during the fastest run
+};
+
+template <typename F>
+static stage_result run_stage(int reps, F &&stage)
+{
+    stage_result best{ 1e300, 0 };
+    for (int r = 0; r < reps; r++) {
+        uint64_t allocations = allocation_count();
+        double start = now_ns();
+        stage();
+        double ns = now_ns() - start;
+        allocations = allocation_count() - allocations;
+        if (ns < best.ns) {
+            best = stage_result{ ns, allocations };
+        }
+    }
+    return best;
+}
+
+// Every stage's best time so far, for --save-baseline/--baseline, keyed by "corpus\tstage"
+static std::map<std::string, double> stage_ns;
+
+// bytes = 0 or count = 0 leave out MB/s or ns/item
+static void report(const char *corpus, const char *stage, const stage_result &result, size_t bytes, size_t count)
+{
+    stage_ns[std::string(corpus) + "\t" + stage] = result.ns;
+
+    char mbs[32] = "-";
+    char per[32] = "-";
+    char allocations[32] = "-";
+    if (bytes) {
+        snprintf(mbs, sizeof(mbs), "%.1f", (double)bytes / (1024.0 * 1024.0) / (result.ns * 1e-9));
+    }
+    if (count) {
+        snprintf(per, sizeof(per), "%.1f", result.ns / (double)count);
+    }
+#ifdef BENCH_COUNT_ALLOCS
+    snprintf(allocations, sizeof(allocations), "%llu", (unsigned long long)result.allocations);
+#endif
+    printf("%-16s %-22s %10.2f %10s %10s %8s\n", corpus, stage, result.ns * 1e-6, mbs, per, allocations);
+}
+
+static bool write_file(const char *filename, const std::vector<char> &text)
+{
+    FILE *fs = fopen(filename, "wb");
+    if (!fs) {
+        fprintf(stderr, "Unable to open %s for writing\n", filename);
+        return false;
+    }
+    bool ok = fwrite(text.data(), 1, text.size(), fs) == text.size();
+    ok = (fclose(fs) == 0) && ok;
+    if (!ok) {
+        fprintf(stderr, "Failed to write %s\n", filename);
+    }
+    return ok;
+}
+
+static int bench_corpus(const corpus_shape &shape, size_t size, uint32_t seed, int reps)
+{
+    std::vector<char> text;
+    generate_corpus(shape, size, seed, &text);
+
+    std::string filename = std::string("ini_bench_") + shape.name + ".ini";
+    if (!write_file(filename.c_str(), text)) {
+        return -1;
+    }
+
+    // read_entire_file(), straight out of the page cache since the file was just written
+    stage_result read = run_stage(reps, [&]() {
+        buffer buf{};
+        if (read_entire_file(filename.c_str(), &buf) == 0) {
+            free(buf.data);
+        }
+    });
+    remove(filename.c_str());
+
+    // parse_ini() with the parser's tables on the heap, then in an arena that's reset between runs
+    size_t properties = 0;
+    int err = 0;
+    stage_result parse = run_stage(reps, [&]() {
+        ini_parser ini{};
+        init_ini(&ini, buffer{ text.data(), (int)text.size() });
+        err = parse_ini(&ini);
+        properties = ini.properties.size();
+    });
+    if (err < 0) {
+        fprintf(stderr, "%s: parse_ini() failed with %d\n", shape.name, err);
+        return err;
+    }
+
+    ini_arena arena{};
+    init_arena(&arena);
+    stage_result parse_arena = run_stage(reps, [&]() {
+        reset_arena(&arena);
+        ini_parser ini{};
+        init_ini(&ini, buffer{ text.data(), (int)text.size() }, &arena);
+        parse_ini(&ini);
+    });
+    free_arena(&arena);
+
+    // Lookup table build, then ini_get() of every property in random order
+    ini_parser ini{};
+    init_ini(&ini, buffer{ text.data(), (int)text.size() });
+    parse_ini(&ini);
+    stage_result build = run_stage(reps, [&]() {
+        ini.lookup = ini_table{};
+        update_ini_lookup(&ini);
+    });
+
+    std::vector<int> order(ini.properties.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = (int)i;
+    }
+    uint32_t state = seed ? seed : 1;
+    for (size_t i = order.size(); i > 1; i--) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        std::swap(order[i - 1], order[state % i]);
+    }
+    size_t found = 0;
+    stage_result lookup = run_stage(reps, [&]() {
+        found = 0;
+        for (int i : order) {
+            const ini_kv &kv = ini.properties[i];
+            found += ini_get(&ini, kv.section, kv.key).data != 0;
+        }
+    });
+    if (found != order.size()) {
+        fprintf(stderr, "%s: only found %zu of %zu properties\n", shape.name, found, order.size());
+        return -1;
+    }
+
+    report(shape.name, "read_entire_file", read, text.size(), 0);
+    report(shape.name, "parse_ini", parse, text.size(), properties);
+    report(shape.name, "parse_ini (arena)", parse_arena, text.size(), properties);
+    report(shape.name, "build lookup", build, 0, properties);
+    report(shape.name, "ini_get", lookup, 0, order.size());
+#ifdef INI_STATS
+    const ini_parse_stats &stats = ini.stats;
+    printf("%-16s %d lines, %d sections, %d properties (%d estimated), %lld comment bytes, %d reallocations, "
+        "%.2f ms tokenize, %.2f ms emit, %zu peak bytes\n", shape.name, stats.lines, stats.sections,
+        stats.properties, stats.estimated_properties, (long long)stats.comment_bytes, stats.reallocations,
+        stats.tokenize_ns * 1e-6, stats.emit_ns * 1e-6, stats.peak_bytes);
+#endif
+    return 0;
+}
+
+// First line of a baseline file, a baseline only compares with runs over the same corpora
+static std::string baseline_header(size_t size, uint32_t seed)
+{
+    char header[64];
+    snprintf(header, sizeof(header), "ini_bench baseline %zu %u", size, seed);
+    return header;
+}
+
+static bool save_baseline(const char *filename, size_t size, uint32_t seed)
+{
+    FILE *fs = fopen(filename, "wb");
+    if (!fs) {
+        fprintf(stderr, "Unable to open %s for writing\n", filename);
+        return false;
+    }
+    fprintf(fs, "%s\n", baseline_header(size, seed).c_str());
+    for (const auto &stage : stage_ns) {
+        fprintf(fs, "%s\t%.0f\n", stage.first.c_str(), stage.second);
+    }
+    bool ok = fclose(fs) == 0;
+    if (!ok) {
+        fprintf(stderr, "Failed to write %s\n", filename);
+    }
+    return ok;
+}
+
+// Returns # of stages more than threshold percent slower than in the baseline, -1 if it can't be read
+static int compare_baseline(const char *filename, size_t size, uint32_t seed, double threshold)
+{
+    FILE *fs = fopen(filename, "rb");
+    if (!fs) {
+        fprintf(stderr, "Unable to open %s for reading\n", filename);
+        return -1;
+    }
+    std::string header = baseline_header(size, seed);
+    char line[256];
+    if (!fgets(line, sizeof(line), fs) || strncmp(line, header.c_str(), header.size()) ||
+        (line[header.size()] != '\n' && line[header.size()] != '\r')) {
+        fclose(fs);
+        fprintf(stderr, "%s wasn't saved with the same --size and --seed\n", filename);
+        return -1;
+    }
+    std::map<std::string, double> baseline;
+    while (fgets(line, sizeof(line), fs)) {
+        char *tab = strrchr(line, '\t');
+        if (tab) {
+            baseline[std::string(line, tab - line)] = atof(tab + 1);
+        }
+    }
+    fclose(fs);
+
+    printf("\n%-40s %10s %10s %8s\n", "stage", "base ms", "ms", "change");
+    int regressions = 0;
+    for (const auto &stage : stage_ns) {
+        auto base = baseline.find(stage.first);
+        if (base == baseline.end() || base->second <= 0) {
+            continue;
+        }
+        std::string name = stage.first;
+        name[name.find('\t')] = ' ';
+        double change = (stage.second / base->second - 1) * 100;
+        bool slower = change > threshold;
+        regressions += slower;
+        printf("%-40s %10.2f %10.2f %+7.1f%%%s\n", name.c_str(), base->second * 1e-6, stage.second * 1e-6, change,
+            slower ? "  REGRESSION" : "");
+    }
+    return regressions;
+}
+
+static int usage()
+{
+    fprintf(stderr, "usage: ini_bench [--size MB] [--reps N] [--corpus NAME] [--seed N] [--write DIR]\n");
+    fprintf(stderr, "                 [--save-baseline FILE] [--baseline FILE [--threshold PERCENT]]\n");
+    fprintf(stderr, "corpora:");
+    for (int i = 0; i < corpus_shape_count; i++) {
+        fprintf(stderr, " %s", corpus_shapes[i].name);
+    }
+    fprintf(stderr, "\n");
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    double size_mb = 64;
+    int reps = 5;
+    uint32_t seed = 1;
+    const char *only = 0;
+    const char *write_dir = 0;
+    const char *save_to = 0;
+    const char *baseline = 0;
+    double threshold = 10;
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : 0;
+        if (!value) {
+            return usage();
+        }
+        if (!strcmp(arg, "--size")) {
+            size_mb = atof(value);
+        } else if (!strcmp(arg, "--reps")) {
+            reps = atoi(value);
+        } else if (!strcmp(arg, "--corpus")) {
+            only = value;
+        } else if (!strcmp(arg, "--seed")) {
+            seed = (uint32_t)strtoul(value, 0, 10);
+        } else if (!strcmp(arg, "--write")) {
+            write_dir = value;
+        } else if (!strcmp(arg, "--save-baseline")) {
+            save_to = value;
+        } else if (!strcmp(arg, "--baseline")) {
+            baseline = value;
+        } else if (!strcmp(arg, "--threshold")) {
+            threshold = atof(value);
+        } else {
+            return usage();
+        }
+        i++;
+    }
+    if (size_mb <= 0 || size_mb >= 2047 || reps < 1 || threshold < 0 || (only && !find_corpus_shape(only))) {
+        return usage();
+    }
+    size_t size = (size_t)(size_mb * 1024 * 1024);
+
+    if (write_dir) {
+        for (int i = 0; i < corpus_shape_count; i++) {
+            const corpus_shape &shape = corpus_shapes[i];
+            if (only && strcmp(only, shape.name)) {
+                continue;
+            }
+            std::vector<char> text;
+            generate_corpus(shape, size, seed, &text);
+            std::string filename = std::string(write_dir) + "/" + shape.name + ".ini";
+            if (!write_file(filename.c_str(), text)) {
+                return 1;
+            }
+            printf("%s (%zu bytes)\n", filename.c_str(), text.size());
+        }
+        return 0;
+    }
+
+    printf("%-16s %-22s %10s %10s %10s %8s\n", "corpus", "stage", "ms", "MB/s", "ns/item", "allocs");
+    for (int i = 0; i < corpus_shape_count; i++) {
+        const corpus_shape &shape = corpus_shapes[i];
+        if (only && strcmp(only, shape.name)) {
+            continue;
+        }
+        if (bench_corpus(shape, size, seed, reps) < 0) {
+            return 1;
+        }
+    }
+
+    if (save_to && !save_baseline(save_to, size, seed)) {
+        return 1;
+    }
+    if (baseline) {
+        int regressions = compare_baseline(baseline, size, seed, threshold);
+        if (regressions) {
+            if (regressions > 0) {
+                fprintf(stderr, "%d stage(s) more than %.0f%% slower than %s\n", regressions, threshold, baseline);
+            }
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include "corpus.h"
+
+#include <cstdio>
+#include <cstring>
+
+const corpus_shape corpus_shapes[] = {
+    //  name             single  keys  value  comment%  comment  crlf
+    { "typical",         false,  12,   24,    20,       40,      false },
+    { "many_sections",   false,  2,    16,    0,        0,       false },
+    { "long_values",     false,  8,    512,   5,        40,      false },
+    { "heavy_comments",  false,  8,    24,    100,      120,     false },
+    { "crlf",            false,  12,   24,    20,       40,      true  },
+    { "huge_section",    true,   0,    24,    10,       40,      false },
+};
+const int corpus_shape_count = (int)(sizeof(corpus_shapes) / sizeof(corpus_shapes[0]));
+
+const corpus_shape *find_corpus_shape(const char *name)
+{
+    for (int i = 0; i < corpus_shape_count; i++) {
+        if (!strcmp(corpus_shapes[i].name, name)) {
+            return &corpus_shapes[i];
+        }
+    }
+    return 0;
+}
+
+// xorshift32, plenty for picking words
+struct corpus_rng {
+    uint32_t state;
+
+    uint32_t next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+    // [0, n)
+    int below(int n) {
+        return n > 0 ? (int)(next() % (uint32_t)n) : 0;
+    }
+};
+
+static const char *const corpus_words[] = {
+    "cache", "worker", "timeout", "server", "path", "enable", "max", "min", "retry", "buffer", "pool",
+    "thread", "level", "log", "port", "host", "queue", "limit", "size", "name", "mode", "file", "dir",
+    "user", "group", "index", "shard", "replica", "region", "zone", "backoff", "interval", "ratio",
+};
+static const int corpus_word_count = (int)(sizeof(corpus_words) / sizeof(corpus_words[0]));
+
+static void append(std::vector<char> *out, const char *s, size_t length)
+{
+    out->insert(out->end(), s, s + length);
+}
+
+static void append(std::vector<char> *out, const char *s)
+{
+    append(out, s, strlen(s));
+}
+
+static void append_newline(std::vector<char> *out, const corpus_shape &shape)
+{
+    append(out, shape.crlf ? "\r\n" : "\n");
+}
+
+// Words and numbers separated by spaces, dots or slashes until it's about length bytes long
+static void append_text(std::vector<char> *out, corpus_rng *rng, int length)
+{
+    static const char separators[] = " ./,_-";
+    size_t end = out->size() + (size_t)(length > 1 ? length : 1);
+    while (out->size() < end) {
+        if (rng->below(4) == 0) {
+            char number[16];
+            int n = snprintf(number, sizeof(number), "%u", rng->next() % 100000);
+            append(out, number, (size_t)n);
+        } else {
+            append(out, corpus_words[rng->below(corpus_word_count)]);
+        }
+        if (out->size() < end) {
+            out->push_back(separators[rng->below((int)sizeof(separators) - 1)]);
+        }
+    }
+    out->resize(end);
+    // Values and comments can't end in whitespace, the parser would trim it off
+    if (out->back() == ' ') {
+        out->back() = 'x';
+    }
+}
+
+void generate_corpus(const corpus_shape &shape, size_t target_bytes, uint32_t seed, std::vector<char> *out)
+{
+    out->clear();
+    out->reserve(target_bytes + 4096);
+    corpus_rng rng{ seed ? seed : 1 };
+
+    char name[64];
+    int section = 0;
+    int key = 0;
+    while (out->size() < target_bytes) {
+        if (key == 0 || (!shape.single_section && key == shape.keys_per_section)) {
+            // Mix of plain and dotted section names, like real configs
+            int n = rng.below(2)
+                ? snprintf(name, sizeof(name), "[section %d]", section)
+                : snprintf(name, sizeof(name), "[%s.%d]", corpus_words[rng.below(corpus_word_count)], section);
+            if (section) {
+                append_newline(out, shape);
+            }
+            append(out, name, (size_t)n);
+            append_newline(out, shape);
+            section++;
+            key = 0;
+        }
+
+        if (rng.below(100) < shape.comment_percent) {
+            append(out, rng.below(2) ? "; " : ";");
+            append_text(out, &rng, shape.comment_length / 2 + rng.below(shape.comment_length + 1));
+            append_newline(out, shape);
+        }
+
+        // Keys are unique within a section (the index makes them so), spacing around '=' varies
+        int n = snprintf(name, sizeof(name), "%s.%s_%d", corpus_words[rng.below(corpus_word_count)],
+            corpus_words[rng.below(corpus_word_count)], key);
+        if (rng.below(8) == 0) {
+            append(out, "  ");
+        }
+        append(out, name, (size_t)n);
+        append(out, rng.below(3) ? " = " : "=");
+        append_text(out, &rng, shape.value_length / 2 + rng.below(shape.value_length + 1));
+        append_newline(out, shape);
+        key++;
+    }
+}
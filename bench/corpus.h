@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Shape of a synthetic .ini file, see generate_corpus()
+struct corpus_shape {
+    const char *name;
+    bool single_section;            // one huge [section] instead of many small ones
+    int keys_per_section;           // properties per [section] (unless single_section)
+    int value_length;               // average value length, each value is between half and 1.5x this long
+    int comment_percent;            // chance of a ; comment line before each property
+    int comment_length;             // average comment length
+    bool crlf;                      // \r\n newlines instead of \n
+};
+
+// The standard set every benchmark runs over
+extern const corpus_shape corpus_shapes[];
+extern const int corpus_shape_count;
+
+// Returns the standard shape called name, or nil if there isn't one
+const corpus_shape *find_corpus_shape(const char *name);
+
+// Replace out with about target_bytes of .ini text of the given shape (it stops after the first property
+// that reaches target_bytes). The same shape, size and seed always give the same bytes.
+void generate_corpus(const corpus_shape &shape, size_t target_bytes, uint32_t seed, std::vector<char> *out);
@@ -0,0 +1,308 @@
+// Differential fuzz target: every input is parsed by each backend, and everything they report has to match
+// what the scalar parse_ini() reports (properties, return code, first error, every error with INI_RECOVER).
+// Any difference aborts, so the fuzzer saves the input.
+//
+//     libFuzzer: cmake -DINI_FUZZ=ON -DCMAKE_CXX_COMPILER=clang++, then ini_fuzz [corpus dirs] [-flags]
+//     AFL       : cmake -DINI_FUZZ=ON -DCMAKE_CXX_COMPILER=afl-clang-fast++, then afl-fuzz ... -- ini_fuzz @@
+//     replay    : ini_fuzz file... (any other compiler), runs every file given once
+//
+// The first byte of each input picks the parse options (see fuzz_options), the second the piece size for
+// ini_feed() and whether backends reuse one parser, the rest is the .ini text.
+
+#include "ini_parser.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Parse options, decoded from the first byte of the input
+struct fuzz_options {
+    int flags;                      // INI_QUOTED_VALUES / INI_RECOVER / INI_VALIDATE_UTF8, and the layouts
+                                    // INI_BUILD_LOOKUP / INI_LAYOUT_SECTIONS / INI_LAYOUT_COMPACT
+    bool writable;                  // ini_parser::writable
+    int piece;                      // ini_feed() size, 1-64 bytes
+    bool reuse;                     // backends parse into one parser that's init_ini()'d again each time
+};
+
+// Everything a backend reported for one input, with slices turned into strings so results from parsers
+// that don't keep the same buffers (streams, reloads) compare
+struct fuzz_kv {
+    std::string section;
+    std::string key;
+    std::string value;
+    int flags;                      // ini_kv::flags, 0 for the layouts that don't keep them
+};
+
+struct fuzz_result {
+    int err;                        // < 0 or 0, the exact negative code isn't part of the contract
+    std::vector<fuzz_kv> properties;
+    std::vector<ini_error> errors;  // first error (if any) followed by INI_RECOVER's list
+    std::vector<std::string> found; // INI_BUILD_LOOKUP: what ini_get() returns for each property
+    std::vector<fuzz_kv> sections;  // INI_LAYOUT_SECTIONS: section_properties in grouped order
+    std::vector<fuzz_kv> compact;   // INI_LAYOUT_COMPACT: every entry
+};
+
+static std::string to_string(slice s)
+{
+    return s.length ? std::string(s.data, s.length) : std::string();
+}
+
+static fuzz_result collect(ini_parser *ini, int err)
+{
+    fuzz_result result{};
+    result.err = err < 0 ? -1 : 0;
+    for (const ini_kv &kv : ini->properties) {
+        result.properties.push_back(fuzz_kv{ to_string(kv.section), to_string(kv.key), to_string(kv.value), kv.flags });
+    }
+    if (ini->error.code) {
+        result.errors.push_back(ini->error);
+    }
+    result.errors.insert(result.errors.end(), ini->errors.begin(), ini->errors.end());
+
+    if (ini->flags & INI_BUILD_LOOKUP) {
+        for (const ini_kv &kv : ini->properties) {
+            result.found.push_back(to_string(ini_get(ini, kv.section, kv.key)));
+        }
+    }
+    if (ini->flags & INI_LAYOUT_SECTIONS) {
+        group_ini_sections(ini);
+        for (const ini_section &section : ini->sections) {
+            for (int i = section.begin; i >= 0 && i < section.end; i++) {
+                const ini_section_kv &kv = ini->section_properties[i];
+                result.sections.push_back(fuzz_kv{ to_string(section.name), to_string(kv.key), to_string(kv.value), 0 });
+            }
+        }
+    }
+    if (ini->flags & INI_LAYOUT_COMPACT) {
+        for (int i = 0; i < ini_compact_count(ini); i++) {
+            result.compact.push_back(fuzz_kv{ to_string(ini_compact_section(ini, i)), to_string(ini_compact_key(ini, i)),
+                to_string(ini_compact_value(ini, i)), 0 });
+        }
+    }
+    return result;
+}
+
+[[noreturn]] static void mismatch(const char *backend, const char *what, size_t i)
+{
+    fprintf(stderr, "ini_fuzz: %s differs from parse_ini(): %s (#%zu)\n", backend, what, i);
+    abort();
+}
+
+static void compare_kvs(const char *backend, const char *what, const std::vector<fuzz_kv> &want,
+    const std::vector<fuzz_kv> &got, int flags_mask)
+{
+    if (got.size() != want.size()) {
+        mismatch(backend, what, got.size());
+    }
+    for (size_t i = 0; i < want.size(); i++) {
+        const fuzz_kv &a = want[i];
+        const fuzz_kv &b = got[i];
+        if (a.section != b.section || a.key != b.key || a.value != b.value ||
+            (a.flags & flags_mask) != (b.flags & flags_mask)) {
+            mismatch(backend, what, i);
+        }
+    }
+}
+
+// Abort unless got is exactly what the reference parse reported
+// flags_mask: ini_kv::flags that have to match, a stream copies every value so where it was unescaped differs
+static void compare(const char *backend, const fuzz_result &want, const fuzz_result &got, int flags_mask = ~0)
+{
+    compare_kvs(backend, "property", want.properties, got.properties, flags_mask);
+    compare_kvs(backend, "section layout", want.sections, got.sections, 0);
+    compare_kvs(backend, "compact layout", want.compact, got.compact, 0);
+    if (got.found != want.found) {
+        mismatch(backend, "lookup", 0);
+    }
+    if (got.err != want.err) {
+        mismatch(backend, "return code", 0);
+    }
+    if (got.errors.size() != want.errors.size()) {
+        mismatch(backend, "error count", got.errors.size());
+    }
+    for (size_t i = 0; i < want.errors.size(); i++) {
+        const ini_error &a = want.errors[i];
+        const ini_error &b = got.errors[i];
+        if (a.code != b.code || a.line != b.line || a.column != b.column) {
+            mismatch(backend, "error", i);
+        }
+    }
+}
+
+// Parser over its own copy of text, since INI_QUOTED_VALUES may unescape into it. Unless options.reuse is
+// set it's a fresh one, otherwise init_ini() has to clear whatever the last backend left in it.
+static void init_fuzz_ini(ini_parser *ini, std::vector<char> *copy, const std::vector<char> &text,
+    const fuzz_options &options, const ini_scanner *scan = 0)
+{
+    *copy = text;
+    copy->push_back(0);
+    if (!options.reuse) {
+        free_arena(&ini->strings);
+        *ini = ini_parser{};
+    }
+    init_ini(ini, buffer{ copy->data(), (int)text.size() });
+    ini->flags = options.flags;
+    ini->writable = options.writable;
+    ini->quiet = true;
+    if (scan) {
+        ini->scan = scan;
+    }
+}
+
+static void fuzz_one(const uint8_t *data, size_t size)
+{
+    if (size < 2 || size > (1 << 20)) {
+        return;
+    }
+    fuzz_options options{};
+    options.flags = ((data[0] & 1) ? INI_QUOTED_VALUES : 0) | ((data[0] & 2) ? INI_RECOVER : 0) |
+        ((data[0] & 4) ? INI_VALIDATE_UTF8 : 0) | ((data[0] & 16) ? INI_BUILD_LOOKUP : 0) |
+        ((data[0] & 32) ? INI_LAYOUT_SECTIONS : 0) | ((data[0] & 64) ? INI_LAYOUT_COMPACT : 0);
+    options.writable = (data[0] & 8) != 0;
+    options.piece = 1 + data[1] % 64;
+    options.reuse = (data[1] & 64) != 0;
+    if ((options.flags & INI_LAYOUT_COMPACT) && (options.flags & INI_QUOTED_VALUES) && !options.writable) {
+        // Unescaped values have to stay in buf for the compact layout's offsets
+        options.flags &= ~INI_LAYOUT_COMPACT;
+    }
+    std::vector<char> text(data + 2, data + size);
+    std::vector<char> copy;
+
+    // Reference: the scalar backend
+    const ini_scanner *scanners[8];
+    int scanner_count = ini_available_scanners(scanners, 8);
+    const ini_scanner *scalar = scanners[scanner_count - 1];
+    ini_parser reference{};
+    init_fuzz_ini(&reference, &copy, text, options, scalar);
+    fuzz_result want = collect(&reference, parse_ini(&reference));
+
+    // Every backend parses into ini, see fuzz_options::reuse
+    ini_parser ini{};
+
+    // Every scanner, serial and two-phase
+    for (int i = 0; i < scanner_count; i++) {
+        init_fuzz_ini(&ini, &copy, text, options, scanners[i]);
+        compare(scanners[i]->name, want, collect(&ini, parse_ini(&ini)));
+
+        init_fuzz_ini(&ini, &copy, text, options, scanners[i]);
+        compare("parse_ini_indexed", want, collect(&ini, parse_ini_indexed(&ini)));
+    }
+
+    // Parallel, with chunks small enough that tiny inputs still get split
+    for (int threads = 2; threads <= 4; threads++) {
+        init_fuzz_ini(&ini, &copy, text, options);
+        compare("parse_ini_parallel", want, collect(&ini, parse_ini_parallel(&ini, threads, 1 + threads * 7)));
+    }
+
+    // Stream, fed in pieces of options.piece bytes. It has no compact layout, and its values are all copies.
+    {
+        ini_stream stream{};
+        init_ini_stream(&stream);
+        stream.ini.flags = options.flags & ~INI_LAYOUT_COMPACT;
+        stream.ini.quiet = true;
+        int err = 0;
+        for (size_t at = 0; at < text.size() && err >= 0; at += options.piece) {
+            size_t piece = text.size() - at < (size_t)options.piece ? text.size() - at : (size_t)options.piece;
+            err = ini_feed(&stream, text.data() + at, (int)piece);
+        }
+        if (err >= 0) {
+            err = ini_finish(&stream);
+        }
+        // A stream can't validate input it hasn't seen yet, so a syntax error before an invalid byte gets
+        // reported first instead of after. Only whether it fails has to match then.
+        fuzz_result got = collect(&stream.ini, err);
+        fuzz_result stream_want = want;
+        stream_want.compact.clear();
+        if ((options.flags & INI_VALIDATE_UTF8) && want.err < 0) {
+            if (got.err >= 0) {
+                mismatch("ini_stream", "return code", 0);
+            }
+        } else {
+            compare("ini_stream", stream_want, got, INI_VALUE_QUOTED);
+        }
+        free_ini_stream(&stream);
+    }
+
+    // Reload from a parse of everything up to the middle line (whether or not that one had errors), then
+    // back into the old parser from a second copy of the text
+    {
+        size_t cut = text.size() / 2;
+        while (cut > 0 && text[cut - 1] != '\n') {
+            cut--;
+        }
+        std::vector<char> old_text(text.begin(), text.begin() + cut);
+        std::vector<char> old_copy;
+        ini_parser old{};
+        init_fuzz_ini(&old, &old_copy, old_text, options);
+        parse_ini(&old);
+        init_fuzz_ini(&ini, &copy, text, options);
+        std::vector<ini_change> changes;
+        compare("reload_ini", want, collect(&ini, reload_ini(&old, ini.buf, &ini, &changes)));
+        if (want.err == 0) {
+            std::vector<char> again(text);
+            again.push_back(0);
+            int err = reload_ini(&ini, buffer{ again.data(), (int)text.size() }, &old, &changes);
+            compare("reload_ini (back)", want, collect(&old, err));
+            if (!changes.empty()) {
+                mismatch("reload_ini (back)", "changes", changes.size());
+            }
+        }
+        free_arena(&old.strings);
+    }
+
+    // Lazy sections only promise the same values, their body errors come when a body gets loaded
+    if (want.err == 0) {
+        init_fuzz_ini(&ini, &copy, text, options);
+        if (index_ini_sections(&ini) < 0) {
+            mismatch("index_ini_sections", "return code", 0);
+        }
+        ini_parser lookup{};
+        std::vector<char> lookup_copy;
+        init_fuzz_ini(&lookup, &lookup_copy, text, options);
+        parse_ini(&lookup);
+        for (size_t i = 0; i < lookup.properties.size(); i++) {
+            const ini_kv &kv = lookup.properties[i];
+            if (ini_find(&lookup, kv.section, kv.key) != (int)i) {
+                continue;
+            }
+            if (to_string(ini_lazy_get(&ini, kv.section, kv.key)) != to_string(kv.value)) {
+                mismatch("ini_lazy_get", "value", i);
+            }
+        }
+        free_arena(&lookup.strings);
+    }
+    free_arena(&ini.strings);
+    free_arena(&reference.strings);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    fuzz_one(data, size);
+    return 0;
+}
+
+#ifndef INI_LIBFUZZER
+// Replay driver for AFL and for reproducing a saved crash without libFuzzer
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++) {
+        // Not read_entire_file(), fuzzers are happy to hand over empty files
+        FILE *fs = fopen(argv[i], "rb");
+        if (!fs) {
+            fprintf(stderr, "Unable to open %s for reading\n", argv[i]);
+            return 1;
+        }
+        std::vector<uint8_t> input;
+        uint8_t chunk[4096];
+        size_t read = 0;
+        while ((read = fread(chunk, 1, sizeof(chunk), fs)) > 0) {
+            input.insert(input.end(), chunk, chunk + read);
+        }
+        fclose(fs);
+        fuzz_one(input.data(), input.size());
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,6126 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "ini_parser.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <charconv>
+#include <climits>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+#ifdef INI_STATS
+#include <chrono>
+#endif
+
+#ifdef INI_ZLIB
+#include <zlib.h>
+#endif
+#ifdef INI_ZSTD
+#include <zstd.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define INI_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define INI_TARGET_SSE2
+#define INI_TARGET_AVX2
+#else
+#define INI_TARGET_SSE2 __attribute__((target("sse2")))
+#define INI_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define INI_NEON 1
+#include <arm_neon.h>
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define INI_IO_URING 1
+#include <linux/io_uring.h>
+#endif
+#endif
+#endif
+#endif
+
+//------------------------------------------------------------------------------
+// Arena
+//------------------------------------------------------------------------------
+
+void init_arena(ini_arena *arena, size_t block_size)
+{
+    *arena = ini_arena{};
+    arena->block_size = block_size;
+}
+
+// Returns size bytes aligned to align (a power of 2) from the arena, or nil if a new block couldn't be allocated
+void *arena_alloc(ini_arena *arena, size_t size, size_t align)
+{
+    ini_arena_block *block = arena->blocks;
+    if (block) {
+        uintptr_t base = (uintptr_t)(block + 1);
+        uintptr_t p = (base + block->used + (align - 1)) & ~(uintptr_t)(align - 1);
+        if (p + size <= base + block->size) {
+            block->used = p + size - base;
+            return (void *)p;
+        }
+    }
+
+    // Current block is full, grab a new one big enough for this allocation
+    size_t block_size = arena->block_size ? arena->block_size : INI_ARENA_BLOCK_SIZE;
+    size_t needed = size + align;
+    if (needed > block_size) {
+        block_size = needed;
+    }
+    size_t total = sizeof(ini_arena_block) + block_size;
+    block = (ini_arena_block *)(arena->alloc ? arena->alloc(total, arena->user) : malloc(total));
+    if (!block) {
+        return 0;
+    }
+    block->next = arena->blocks;
+    block->size = block_size;
+    block->used = 0;
+    arena->blocks = block;
+
+    uintptr_t base = (uintptr_t)(block + 1);
+    uintptr_t p = (base + (align - 1)) & ~(uintptr_t)(align - 1);
+    block->used = p + size - base;
+    return (void *)p;
+}
+
+static void free_arena_block(ini_arena *arena, ini_arena_block *block)
+{
+    if (arena->free) {
+        arena->free(block, arena->user);
+    } else {
+        free(block);
+    }
+}
+
+// Throw away everything allocated from the arena, but hang on to its biggest block for the next parse
+// WARN: anything that still points into the arena (e.g. a parser's properties) is invalid afterwards!!
+void reset_arena(ini_arena *arena)
+{
+    ini_arena_block *keep = 0;
+    ini_arena_block *block = arena->blocks;
+    while (block) {
+        ini_arena_block *next = block->next;
+        if (!keep || block->size > keep->size) {
+            if (keep) {
+                free_arena_block(arena, keep);
+            }
+            keep = block;
+        } else {
+            free_arena_block(arena, block);
+        }
+        block = next;
+    }
+    if (keep) {
+        keep->next = 0;
+        keep->used = 0;
+    }
+    arena->blocks = keep;
+}
+
+// Release every block owned by the arena
+// WARN: anything that still points into the arena (e.g. a parser's properties) is invalid afterwards!!
+void free_arena(ini_arena *arena)
+{
+    ini_arena_block *block = arena->blocks;
+    while (block) {
+        ini_arena_block *next = block->next;
+        free_arena_block(arena, block);
+        block = next;
+    }
+    arena->blocks = 0;
+}
+
+//------------------------------------------------------------------------------
+// Byte scanners
+//------------------------------------------------------------------------------
+
+static inline int ini_ctz32(uint32_t x)
+{
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward(&i, x);
+    return (int)i;
+#else
+    return __builtin_ctz(x);
+#endif
+}
+
+static inline int ini_ctz64(uint64_t x)
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long i;
+    _BitScanForward64(&i, x);
+    return (int)i;
+#elif defined(_MSC_VER)
+    uint32_t lo = (uint32_t)x;
+    return lo ? ini_ctz32(lo) : 32 + ini_ctz32((uint32_t)(x >> 32));
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+// Scalar fallback, this is what every other backend has to agree with
+static const char *scalar_find_eol(const char *p, const char *end)
+{
+    while (p < end && *p != '\r' && *p != '\n') {
+        p++;
+    }
+    return p;
+}
+
+static const char *scalar_find_eq_eol(const char *p, const char *end)
+{
+    while (p < end && *p != '=' && *p != '\r' && *p != '\n') {
+        p++;
+    }
+    return p;
+}
+
+static const char *scalar_find_char(const char *p, const char *end, char c)
+{
+    while (p < end && *p != c) {
+        p++;
+    }
+    return p;
+}
+
+static uint64_t scalar_classify64(const char *p)
+{
+    uint64_t mask = 0;
+    for (int i = 0; i < 64; i++) {
+        switch (p[i]) {
+            case '\n': case '\r': case '=': case ';': case '[': case ']': {
+                mask |= (uint64_t)1 << i;
+                break;
+            }
+        }
+    }
+    return mask;
+}
+
+static void scalar_count(const char *p, const char *end, ini_byte_counts *counts)
+{
+    for (; p < end; p++) {
+        counts->lf += *p == '\n';
+        counts->cr += *p == '\r';
+        counts->eq += *p == '=';
+    }
+}
+
+// End of the UTF-8 sequence starting at p (which isn't ASCII), or nil if it's invalid: a stray continuation
+// byte, a truncated sequence, an overlong encoding, a surrogate or anything past U+10FFFF
+static const char *utf8_sequence_end(const char *p, const char *end)
+{
+    const unsigned char *s = (const unsigned char *)p;
+    int length;
+    uint32_t cp;
+    uint32_t min;
+    if ((s[0] & 0xe0) == 0xc0) {
+        length = 2; cp = s[0] & 0x1f; min = 0x80;
+    } else if ((s[0] & 0xf0) == 0xe0) {
+        length = 3; cp = s[0] & 0x0f; min = 0x800;
+    } else if ((s[0] & 0xf8) == 0xf0) {
+        length = 4; cp = s[0] & 0x07; min = 0x10000;
+    } else {
+        return 0;
+    }
+    if (end - p < length) {
+        return 0;
+    }
+    for (int i = 1; i < length; i++) {
+        if ((s[i] & 0xc0) != 0x80) {
+            return 0;
+        }
+        cp = (cp << 6) | (s[i] & 0x3f);
+    }
+    if (cp < min || cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff)) {
+        return 0;
+    }
+    return p + length;
+}
+
+static const char *scalar_validate_utf8(const char *p, const char *end)
+{
+    while (p < end) {
+        uint64_t word;
+        if (end - p >= 8 && (memcpy(&word, p, 8), !(word & 0x8080808080808080ull))) {
+            p += 8;
+        } else if (!(*p & 0x80)) {
+            p++;
+        } else {
+            const char *next = utf8_sequence_end(p, end);
+            if (!next) {
+                return p;
+            }
+            p = next;
+        }
+    }
+    return p;
+}
+
+#if INI_X86 || INI_NEON
+// Tables for the vectorized UTF-8 validators (Keiser & Lemire, "Validating UTF-8 In Less Than One
+// Instruction Per Byte"): three nibble lookups of each byte and the one before it flag every invalid 2-byte
+// pattern, the 3rd/4th bytes of longer sequences are checked against the lead byte 2/3 back. Error classes,
+// set in a table entry if that nibble can be part of it:
+#define UTF8_TOO_SHORT      0x01    // lead byte not followed by a continuation
+#define UTF8_TOO_LONG       0x02    // ASCII followed by a continuation
+#define UTF8_OVERLONG_3     0x04    // E0 80..9F
+#define UTF8_TOO_LARGE      0x08    // F4 90..BF, or F5..FF
+#define UTF8_SURROGATE      0x10    // ED A0..BF
+#define UTF8_OVERLONG_2     0x20    // C0..C1 followed by a continuation
+#define UTF8_TOO_LARGE_1000 0x40    // F5..FF 80..8F
+#define UTF8_OVERLONG_4     0x40    // F0 80..8F
+#define UTF8_TWO_CONTS      0x80    // two continuations in a row, fine only as the 2nd/3rd or 3rd/4th byte
+#define UTF8_CARRY          (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+static const uint8_t utf8_byte_1_high[16] = {
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+    UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+    UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+    UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+};
+
+static const uint8_t utf8_byte_1_low[16] = {
+    UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_OVERLONG_2,
+    UTF8_CARRY,
+    UTF8_CARRY,
+    UTF8_CARRY | UTF8_TOO_LARGE,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+};
+
+static const uint8_t utf8_byte_2_high[16] = {
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+};
+
+// Tail of the vectorized validators: the bytes from p on (the tail, or the block with the error in it) are
+// decoded one sequence at a time to pin down the exact byte. Everything before p is valid, except that it
+// may end in a sequence that runs into p, so start from the last sequence that begins before p.
+static const char *utf8_validate_rest(const char *begin, const char *p, const char *end)
+{
+    const char *q = p - begin > 3 ? p - 3 : begin;
+    while (q < p && (*q & 0xc0) == 0x80) {
+        q++;
+    }
+    return scalar_validate_utf8(q, end);
+}
+#endif
+
+const ini_scanner ini_scanner_scalar = {
+    "scalar", scalar_find_eol, scalar_find_eq_eol, scalar_find_char, scalar_classify64, scalar_count,
+    scalar_validate_utf8
+};
+
+#if INI_X86
+INI_TARGET_SSE2 static const char *sse2_find_eol(const char *p, const char *end)
+{
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)));
+        if (mask) {
+            return p + ini_ctz32(mask);
+        }
+        p += 16;
+    }
+    return scalar_find_eol(p, end);
+}
+
+INI_TARGET_SSE2 static const char *sse2_find_eq_eol(const char *p, const char *end)
+{
+    const __m128i eq = _mm_set1_epi8('=');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(v, eq), _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(hit);
+        if (mask) {
+            return p + ini_ctz32(mask);
+        }
+        p += 16;
+    }
+    return scalar_find_eq_eol(p, end);
+}
+
+INI_TARGET_SSE2 static const char *sse2_find_char(const char *p, const char *end, char c)
+{
+    const __m128i needle = _mm_set1_epi8(c);
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+        if (mask) {
+            return p + ini_ctz32(mask);
+        }
+        p += 16;
+    }
+    return scalar_find_char(p, end, c);
+}
+
+INI_TARGET_SSE2 static uint64_t sse2_classify64(const char *p)
+{
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i eq = _mm_set1_epi8('=');
+    const __m128i semi = _mm_set1_epi8(';');
+    const __m128i open = _mm_set1_epi8('[');
+    const __m128i close = _mm_set1_epi8(']');
+    uint64_t mask = 0;
+    for (int i = 0; i < 64; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i hit = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr)),
+            _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, eq), _mm_cmpeq_epi8(v, semi)),
+                _mm_or_si128(_mm_cmpeq_epi8(v, open), _mm_cmpeq_epi8(v, close))));
+        mask |= (uint64_t)(uint32_t)_mm_movemask_epi8(hit) << i;
+    }
+    return mask;
+}
+
+// Horizontal sum of the 16 byte counters in v
+INI_TARGET_SSE2 static int sse2_sum_bytes(__m128i v)
+{
+    __m128i sums = _mm_sad_epu8(v, _mm_setzero_si128());
+    return _mm_cvtsi128_si32(sums) + _mm_extract_epi16(sums, 4);
+}
+
+INI_TARGET_SSE2 static void sse2_count(const char *p, const char *end, ini_byte_counts *counts)
+{
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i eq = _mm_set1_epi8('=');
+    while (end - p >= 16) {
+        // Matches are 0xff (-1), so subtracting counts them. Byte counters overflow after 255 steps.
+        __m128i lf_count = _mm_setzero_si128();
+        __m128i cr_count = _mm_setzero_si128();
+        __m128i eq_count = _mm_setzero_si128();
+        for (int steps = 0; steps < 255 && end - p >= 16; steps++, p += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *)p);
+            lf_count = _mm_sub_epi8(lf_count, _mm_cmpeq_epi8(v, lf));
+            cr_count = _mm_sub_epi8(cr_count, _mm_cmpeq_epi8(v, cr));
+            eq_count = _mm_sub_epi8(eq_count, _mm_cmpeq_epi8(v, eq));
+        }
+        counts->lf += sse2_sum_bytes(lf_count);
+        counts->cr += sse2_sum_bytes(cr_count);
+        counts->eq += sse2_sum_bytes(eq_count);
+    }
+    scalar_count(p, end, counts);
+}
+
+// SSE2 has no byte shuffle for the table lookups the AVX2 version uses, so this only skips ASCII 16 bytes
+// at a time and decodes everything else
+INI_TARGET_SSE2 static const char *sse2_validate_utf8(const char *p, const char *end)
+{
+    while (p < end) {
+        if (end - p >= 16 && !_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)p))) {
+            p += 16;
+        } else if (!(*p & 0x80)) {
+            p++;
+        } else {
+            const char *next = utf8_sequence_end(p, end);
+            if (!next) {
+                return p;
+            }
+            p = next;
+        }
+    }
+    return p;
+}
+
+const ini_scanner ini_scanner_sse2 = {
+    "sse2", sse2_find_eol, sse2_find_eq_eol, sse2_find_char, sse2_classify64, sse2_count, sse2_validate_utf8
+};
+
+INI_TARGET_AVX2 static const char *avx2_find_eol(const char *p, const char *end)
+{
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf)));
+        if (mask) {
+            return p + ini_ctz32(mask);
+        }
+        p += 32;
+    }
+    return sse2_find_eol(p, end);
+}
+
+INI_TARGET_AVX2 static const char *avx2_find_eq_eol(const char *p, const char *end)
+{
+    const __m256i eq = _mm256_set1_epi8('=');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(v, eq), _mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf)));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(hit);
+        if (mask) {
+            return p + ini_ctz32(mask);
+        }
+        p += 32;
+    }
+    return sse2_find_eq_eol(p, end);
+}
+
+INI_TARGET_AVX2 static const char *avx2_find_char(const char *p, const char *end, char c)
+{
+    const __m256i needle = _mm256_set1_epi8(c);
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle));
+        if (mask) {
+            return p + ini_ctz32(mask);
+        }
+        p += 32;
+    }
+    return sse2_find_char(p, end, c);
+}
+
+INI_TARGET_AVX2 static uint64_t avx2_classify64(const char *p)
+{
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i eq = _mm256_set1_epi8('=');
+    const __m256i semi = _mm256_set1_epi8(';');
+    const __m256i open = _mm256_set1_epi8('[');
+    const __m256i close = _mm256_set1_epi8(']');
+    uint64_t mask = 0;
+    for (int i = 0; i < 64; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i hit = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, lf), _mm256_cmpeq_epi8(v, cr)),
+            _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, eq), _mm256_cmpeq_epi8(v, semi)),
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, open), _mm256_cmpeq_epi8(v, close))));
+        mask |= (uint64_t)(uint32_t)_mm256_movemask_epi8(hit) << i;
+    }
+    return mask;
+}
+
+// Horizontal sum of the 32 byte counters in v
+INI_TARGET_AVX2 static int avx2_sum_bytes(__m256i v)
+{
+    __m256i sums = _mm256_sad_epu8(v, _mm256_setzero_si256());
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+    return _mm_cvtsi128_si32(half) + _mm_extract_epi16(half, 4);
+}
+
+INI_TARGET_AVX2 static void avx2_count(const char *p, const char *end, ini_byte_counts *counts)
+{
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i eq = _mm256_set1_epi8('=');
+    while (end - p >= 32) {
+        __m256i lf_count = _mm256_setzero_si256();
+        __m256i cr_count = _mm256_setzero_si256();
+        __m256i eq_count = _mm256_setzero_si256();
+        for (int steps = 0; steps < 255 && end - p >= 32; steps++, p += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)p);
+            lf_count = _mm256_sub_epi8(lf_count, _mm256_cmpeq_epi8(v, lf));
+            cr_count = _mm256_sub_epi8(cr_count, _mm256_cmpeq_epi8(v, cr));
+            eq_count = _mm256_sub_epi8(eq_count, _mm256_cmpeq_epi8(v, eq));
+        }
+        counts->lf += avx2_sum_bytes(lf_count);
+        counts->cr += avx2_sum_bytes(cr_count);
+        counts->eq += avx2_sum_bytes(eq_count);
+    }
+    sse2_count(p, end, counts);
+}
+
+// Each byte of input that can't be where it is, given the bytes before it (the end of prev)
+INI_TARGET_AVX2 static __m256i avx2_utf8_errors(__m256i input, __m256i prev)
+{
+    const __m256i low_nibble = _mm256_set1_epi8(0x0f);
+    const __m256i byte_1_high = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)utf8_byte_1_high));
+    const __m256i byte_1_low = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)utf8_byte_1_low));
+    const __m256i byte_2_high = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)utf8_byte_2_high));
+
+    // prevN = input shifted N bytes later, with the end of prev shifted in
+    __m256i carry = _mm256_permute2x128_si256(prev, input, 0x21);
+    __m256i prev1 = _mm256_alignr_epi8(input, carry, 15);
+    __m256i prev2 = _mm256_alignr_epi8(input, carry, 14);
+    __m256i prev3 = _mm256_alignr_epi8(input, carry, 13);
+
+    __m256i special = _mm256_and_si256(
+        _mm256_and_si256(
+            _mm256_shuffle_epi8(byte_1_high, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), low_nibble)),
+            _mm256_shuffle_epi8(byte_1_low, _mm256_and_si256(prev1, low_nibble))),
+        _mm256_shuffle_epi8(byte_2_high, _mm256_and_si256(_mm256_srli_epi16(input, 4), low_nibble)));
+
+    // Only the 3rd byte of a 3+ byte sequence and the 4th of a 4 byte one may be a second continuation
+    __m256i third = _mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xe0 - 0x80)));
+    __m256i fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xf0 - 0x80)));
+    __m256i must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8((char)0x80));
+    return _mm256_xor_si256(must_continue, special);
+}
+
+INI_TARGET_AVX2 static const char *avx2_validate_utf8(const char *p, const char *end)
+{
+    // A lead byte in the last 1/2/3 bytes of a block still needs continuations from the next one
+    const __m256i incomplete_max = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        (char)(0xf0 - 1), (char)(0xe0 - 1), (char)(0xc0 - 1));
+    const char *begin = p;
+    __m256i prev = _mm256_setzero_si256();
+    __m256i incomplete = _mm256_setzero_si256();
+    while (end - p >= 32) {
+        __m256i input = _mm256_loadu_si256((const __m256i *)p);
+        __m256i error;
+        if (!_mm256_movemask_epi8(input)) {
+            error = incomplete;
+        } else {
+            error = avx2_utf8_errors(input, prev);
+            incomplete = _mm256_subs_epu8(input, incomplete_max);
+        }
+        if (!_mm256_testz_si256(error, error)) {
+            break;
+        }
+        if (!_mm256_movemask_epi8(input)) {
+            incomplete = _mm256_setzero_si256();
+        }
+        prev = input;
+        p += 32;
+    }
+
+    return utf8_validate_rest(begin, p, end);
+}
+
+const ini_scanner ini_scanner_avx2 = {
+    "avx2", avx2_find_eol, avx2_find_eq_eol, avx2_find_char, avx2_classify64, avx2_count, avx2_validate_utf8
+};
+
+static bool cpu_has_sse2()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    return true;  // part of the x86-64 baseline
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#else
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+static bool cpu_has_avx2()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    // OS has to save the YMM registers on context switch too, or AVX instructions will fault
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 0x6) != 0x6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+#if INI_NEON
+// NEON has no movemask, narrowing each 0xff/0x00 compare byte to a nibble gives a 64-bit mask with 4
+// bits per input byte instead
+static inline uint64_t neon_mask(uint8x16_t hit)
+{
+    uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(hit), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(narrowed), 0);
+}
+
+static const char *neon_find_eol(const char *p, const char *end)
+{
+    const uint8x16_t cr = vdupq_n_u8('\r');
+    const uint8x16_t lf = vdupq_n_u8('\n');
+    while (end - p >= 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t *)p);
+        uint64_t mask = neon_mask(vorrq_u8(vceqq_u8(v, cr), vceqq_u8(v, lf)));
+        if (mask) {
+            return p + (ini_ctz64(mask) >> 2);
+        }
+        p += 16;
+    }
+    return scalar_find_eol(p, end);
+}
+
+static const char *neon_find_eq_eol(const char *p, const char *end)
+{
+    const uint8x16_t eq = vdupq_n_u8('=');
+    const uint8x16_t cr = vdupq_n_u8('\r');
+    const uint8x16_t lf = vdupq_n_u8('\n');
+    while (end - p >= 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t *)p);
+        uint64_t mask = neon_mask(vorrq_u8(vceqq_u8(v, eq), vorrq_u8(vceqq_u8(v, cr), vceqq_u8(v, lf))));
+        if (mask) {
+            return p + (ini_ctz64(mask) >> 2);
+        }
+        p += 16;
+    }
+    return scalar_find_eq_eol(p, end);
+}
+
+static const char *neon_find_char(const char *p, const char *end, char c)
+{
+    const uint8x16_t needle = vdupq_n_u8((uint8_t)c);
+    while (end - p >= 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t *)p);
+        uint64_t mask = neon_mask(vceqq_u8(v, needle));
+        if (mask) {
+            return p + (ini_ctz64(mask) >> 2);
+        }
+        p += 16;
+    }
+    return scalar_find_char(p, end, c);
+}
+
+static uint64_t neon_classify64(const char *p)
+{
+    const uint8x16_t lf = vdupq_n_u8('\n');
+    const uint8x16_t cr = vdupq_n_u8('\r');
+    const uint8x16_t eq = vdupq_n_u8('=');
+    const uint8x16_t semi = vdupq_n_u8(';');
+    const uint8x16_t open = vdupq_n_u8('[');
+    const uint8x16_t close = vdupq_n_u8(']');
+    const uint8x16_t bits = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+                              0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80 };
+    uint8x16_t hit[4];
+    for (int i = 0; i < 4; i++) {
+        uint8x16_t v = vld1q_u8((const uint8_t *)p + i * 16);
+        uint8x16_t m = vorrq_u8(
+            vorrq_u8(vceqq_u8(v, lf), vceqq_u8(v, cr)),
+            vorrq_u8(
+                vorrq_u8(vceqq_u8(v, eq), vceqq_u8(v, semi)),
+                vorrq_u8(vceqq_u8(v, open), vceqq_u8(v, close))));
+        hit[i] = vandq_u8(m, bits);
+    }
+    // Pairwise adds fold each group of 8 weighted lanes into one mask byte
+    uint8x16_t sum = vpaddq_u8(vpaddq_u8(hit[0], hit[1]), vpaddq_u8(hit[2], hit[3]));
+    sum = vpaddq_u8(sum, sum);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(sum), 0);
+}
+
+static void neon_count(const char *p, const char *end, ini_byte_counts *counts)
+{
+    const uint8x16_t lf = vdupq_n_u8('\n');
+    const uint8x16_t cr = vdupq_n_u8('\r');
+    const uint8x16_t eq = vdupq_n_u8('=');
+    while (end - p >= 16) {
+        uint8x16_t lf_count = vdupq_n_u8(0);
+        uint8x16_t cr_count = vdupq_n_u8(0);
+        uint8x16_t eq_count = vdupq_n_u8(0);
+        for (int steps = 0; steps < 255 && end - p >= 16; steps++, p += 16) {
+            uint8x16_t v = vld1q_u8((const uint8_t *)p);
+            lf_count = vsubq_u8(lf_count, vceqq_u8(v, lf));
+            cr_count = vsubq_u8(cr_count, vceqq_u8(v, cr));
+            eq_count = vsubq_u8(eq_count, vceqq_u8(v, eq));
+        }
+        counts->lf += vaddlvq_u8(lf_count);
+        counts->cr += vaddlvq_u8(cr_count);
+        counts->eq += vaddlvq_u8(eq_count);
+    }
+    scalar_count(p, end, counts);
+}
+
+// Same algorithm as avx2_validate_utf8(), with the tables shared
+static const char *neon_validate_utf8(const char *p, const char *end)
+{
+    const uint8x16_t low_nibble = vdupq_n_u8(0x0f);
+    const uint8x16_t byte_1_high = vld1q_u8(utf8_byte_1_high);
+    const uint8x16_t byte_1_low = vld1q_u8(utf8_byte_1_low);
+    const uint8x16_t byte_2_high = vld1q_u8(utf8_byte_2_high);
+    const uint8x16_t incomplete_max = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                        0xff, 0xff, 0xff, 0xff, 0xff, 0xf0 - 1, 0xe0 - 1, 0xc0 - 1 };
+    const char *begin = p;
+    uint8x16_t prev = vdupq_n_u8(0);
+    uint8x16_t incomplete = vdupq_n_u8(0);
+    while (end - p >= 16) {
+        uint8x16_t input = vld1q_u8((const uint8_t *)p);
+        uint8x16_t error;
+        bool ascii = vmaxvq_u8(input) < 0x80;
+        if (ascii) {
+            error = incomplete;
+        } else {
+            uint8x16_t prev1 = vextq_u8(prev, input, 15);
+            uint8x16_t prev2 = vextq_u8(prev, input, 14);
+            uint8x16_t prev3 = vextq_u8(prev, input, 13);
+            uint8x16_t special = vandq_u8(
+                vandq_u8(
+                    vqtbl1q_u8(byte_1_high, vshrq_n_u8(prev1, 4)),
+                    vqtbl1q_u8(byte_1_low, vandq_u8(prev1, low_nibble))),
+                vqtbl1q_u8(byte_2_high, vshrq_n_u8(input, 4)));
+            uint8x16_t third = vqsubq_u8(prev2, vdupq_n_u8(0xe0 - 0x80));
+            uint8x16_t fourth = vqsubq_u8(prev3, vdupq_n_u8(0xf0 - 0x80));
+            uint8x16_t must_continue = vandq_u8(vorrq_u8(third, fourth), vdupq_n_u8(0x80));
+            error = veorq_u8(must_continue, special);
+            incomplete = vqsubq_u8(input, incomplete_max);
+        }
+        if (vmaxvq_u8(error)) {
+            break;
+        }
+        if (ascii) {
+            incomplete = vdupq_n_u8(0);
+        }
+        prev = input;
+        p += 16;
+    }
+
+    return utf8_validate_rest(begin, p, end);
+}
+
+const ini_scanner ini_scanner_neon = {
+    "neon", neon_find_eol, neon_find_eq_eol, neon_find_char, neon_classify64, neon_count, neon_validate_utf8
+};
+#endif
+
+// Fills list with every scanner backend this CPU can run, fastest first
+// Returns the number of backends written to list
+int ini_available_scanners(const ini_scanner **list, int max)
+{
+    int count = 0;
+#if INI_X86
+    if (count < max && cpu_has_avx2()) list[count++] = &ini_scanner_avx2;
+    if (count < max && cpu_has_sse2()) list[count++] = &ini_scanner_sse2;
+#endif
+#if INI_NEON
+    if (count < max) list[count++] = &ini_scanner_neon;
+#endif
+    if (count < max) list[count++] = &ini_scanner_scalar;
+    return count;
+}
+
+// Fastest scanner backend this CPU supports, detected once on first call
+const ini_scanner *ini_best_scanner()
+{
+    static const ini_scanner *best = []() {
+        const ini_scanner *list[1];
+        ini_available_scanners(list, 1);
+        return list[0];
+    }();
+    return best;
+}
+
+//------------------------------------------------------------------------------
+// Lookup
+//------------------------------------------------------------------------------
+
+// FNV-1a over section, then key. A separator byte is mixed in between so "ab"+"c" != "a"+"bc".
+static uint32_t hash_section_key(slice section, slice key)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < section.length; i++) {
+        hash = (hash ^ (unsigned char)section.data[i]) * 16777619u;
+    }
+    hash = (hash ^ 0xff) * 16777619u;
+    for (int i = 0; i < key.length; i++) {
+        hash = (hash ^ (unsigned char)key.data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static bool slice_equal(slice a, slice b)
+{
+    return a.length == b.length && (a.length == 0 || !memcmp(a.data, b.data, a.length));
+}
+
+// Byte-wise order, a prefix sorts before anything it's a prefix of
+static int compare_slices(slice a, slice b)
+{
+    int n = a.length < b.length ? a.length : b.length;
+    int c = n > 0 ? memcmp(a.data, b.data, (size_t)n) : 0;
+    return c ? c : a.length - b.length;
+}
+
+// Make room for one more entry, keeping load factor <= 1/2 so probe sequences stay short
+static void table_grow(ini_table *table)
+{
+    if ((table->count + 1) * 2 > (int)table->slots.size()) {
+        size_t new_size = table->slots.empty() ? 16 : table->slots.size() * 2;
+        ini_vector<ini_slot> old(table->slots.get_allocator());
+        old.swap(table->slots);
+        table->slots.assign(new_size, ini_slot{ 0, -1 });
+        size_t mask = new_size - 1;
+        for (const ini_slot &slot : old) {
+            if (slot.index >= 0) {
+                size_t i = slot.hash & mask;
+                while (table->slots[i].index >= 0) {
+                    i = (i + 1) & mask;
+                }
+                table->slots[i] = slot;
+            }
+        }
+    }
+}
+
+// Insert properties[kv] into the table. If section+key is already in there, the later property wins.
+static void lookup_insert(ini_parser *ini, int kv)
+{
+    ini_table *table = &ini->lookup;
+    table_grow(table);
+
+    const ini_kv &prop = ini->properties[kv];
+    uint32_t hash = hash_section_key(prop.section, prop.key);
+    size_t mask = table->slots.size() - 1;
+    size_t i = hash & mask;
+    while (table->slots[i].index >= 0) {
+        ini_slot &slot = table->slots[i];
+        if (slot.hash == hash) {
+            const ini_kv &other = ini->properties[slot.index];
+            if (slice_equal(other.section, prop.section) && slice_equal(other.key, prop.key)) {
+                slot.index = kv;
+                return;
+            }
+        }
+        i = (i + 1) & mask;
+    }
+    table->slots[i] = ini_slot{ hash, kv };
+    table->count++;
+}
+
+// Insert any properties the lookup table hasn't seen yet
+void update_ini_lookup(ini_parser *ini)
+{
+    ini_table *table = &ini->lookup;
+    int count = (int)ini->properties.size();
+    for (int kv = table->indexed; kv < count; kv++) {
+        lookup_insert(ini, kv);
+    }
+    table->indexed = count;
+}
+
+// Find a property by section and key in O(1), building (or catching up) the lookup table if needed
+// section: section name, empty for properties that come before any [section] header
+// Returns index into ini->properties, or -1 if there is no such property
+int ini_find(ini_parser *ini, slice section, slice key)
+{
+    ini_table *table = &ini->lookup;
+    if (table->indexed < (int)ini->properties.size()) {
+        update_ini_lookup(ini);
+    }
+    if (!table->count) {
+        return -1;
+    }
+
+    uint32_t hash = hash_section_key(section, key);
+    size_t mask = table->slots.size() - 1;
+    size_t i = hash & mask;
+    while (table->slots[i].index >= 0) {
+        const ini_slot &slot = table->slots[i];
+        if (slot.hash == hash) {
+            const ini_kv &prop = ini->properties[slot.index];
+            if (slice_equal(prop.section, section) && slice_equal(prop.key, key)) {
+                return slot.index;
+            }
+        }
+        i = (i + 1) & mask;
+    }
+    return -1;
+}
+
+// Returns value of [section] key, or an empty slice (data == 0) if there is no such property
+slice ini_get(ini_parser *ini, slice section, slice key)
+{
+    int kv = ini_find(ini, section, key);
+    return kv >= 0 ? ini->properties[kv].value : slice{};
+}
+
+slice ini_get(ini_parser *ini, const char *section, const char *key)
+{
+    assert(section);
+    assert(key);
+    slice s{ (char *)section, (int)strlen(section) };
+    slice k{ (char *)key, (int)strlen(key) };
+    return ini_get(ini, s, k);
+}
+
+//------------------------------------------------------------------------------
+// Sections
+//------------------------------------------------------------------------------
+
+static uint32_t hash_slice(slice s)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < s.length; i++) {
+        hash = (hash ^ (unsigned char)s.data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Returns index of section name in ini->sections, adding it to the table if this is the first time we've
+// seen it. Index 0 is always the unnamed section properties before the first [header] belong to.
+static uint32_t intern_section(ini_parser *ini, slice name)
+{
+    if (ini->sections.empty()) {
+        ini->sections.push_back(ini_section{ slice{}, -1, -1 });
+    }
+    if (!name.length) {
+        return 0;
+    }
+
+    ini_table *table = &ini->section_table;
+    table_grow(table);
+
+    uint32_t hash = hash_slice(name);
+    size_t mask = table->slots.size() - 1;
+    size_t i = hash & mask;
+    while (table->slots[i].index >= 0) {
+        const ini_slot &slot = table->slots[i];
+        if (slot.hash == hash && slice_equal(ini->sections[slot.index].name, name)) {
+            return (uint32_t)slot.index;
+        }
+        i = (i + 1) & mask;
+    }
+
+    int index = (int)ini->sections.size();
+    ini->sections.push_back(ini_section{ name, -1, -1 });
+    table->slots[i] = ini_slot{ hash, index };
+    table->count++;
+    return (uint32_t)index;
+}
+
+// Append a property to its section's range in section_properties. As long as every section's properties
+// are contiguous in the file that's all there is to it, otherwise the ranges get fixed up by
+// group_ini_sections() the next time someone asks for one.
+static void store_section_kv(ini_parser *ini, const ini_kv &kv)
+{
+    ini_vector<ini_section_kv> &props = ini->section_properties;
+    if (props.empty()) {
+        props.reserve(ini->estimated_properties);
+    }
+
+    ini_section &section = ini->sections[ini->section_index];
+    int index = (int)props.size();
+    if (section.end == index) {
+        section.end++;
+    } else {
+        if (section.begin >= 0) {
+            // This section already has a range somewhere earlier, it'll need regrouping
+            ini->sections_grouped = false;
+        } else {
+            section.begin = index;
+        }
+        section.end = index + 1;
+    }
+    props.push_back(ini_section_kv{ ini->section_index, kv.key, kv.value });
+}
+
+// Stable counting sort of section_properties by section, so each section's properties are one contiguous
+// [begin, end) range again (in file order within the section)
+void group_ini_sections(ini_parser *ini)
+{
+    if (ini->sections_grouped) {
+        return;
+    }
+
+    ini_vector<ini_section_kv> &props = ini->section_properties;
+    ini_vector<int> counts(ini->sections.size() + 1, 0, ini_allocator<int>(ini->arena));
+    for (const ini_section_kv &kv : props) {
+        counts[kv.section + 1]++;
+    }
+    for (size_t s = 0; s < ini->sections.size(); s++) {
+        counts[s + 1] += counts[s];
+        ini->sections[s].begin = counts[s];
+        ini->sections[s].end = counts[s + 1];
+    }
+
+    ini_vector<ini_section_kv> grouped(props.size(), ini_section_kv{}, props.get_allocator());
+    for (const ini_section_kv &kv : props) {
+        grouped[counts[kv.section]++] = kv;
+    }
+    props.swap(grouped);
+    ini->sections_grouped = true;
+}
+
+// Returns index of the named section in ini->sections, or -1 if there is no such section.
+// The unnamed section before the first [header] is "".
+int ini_find_section(ini_parser *ini, slice name)
+{
+    if (ini->sections.empty()) {
+        return -1;
+    }
+    if (!name.length) {
+        return 0;
+    }
+
+    ini_table *table = &ini->section_table;
+    if (!table->count) {
+        return -1;
+    }
+    uint32_t hash = hash_slice(name);
+    size_t mask = table->slots.size() - 1;
+    size_t i = hash & mask;
+    while (table->slots[i].index >= 0) {
+        const ini_slot &slot = table->slots[i];
+        if (slot.hash == hash && slice_equal(ini->sections[slot.index].name, name)) {
+            return slot.index;
+        }
+        i = (i + 1) & mask;
+    }
+    return -1;
+}
+
+// Range of the named section's properties in ini->section_properties (needs INI_LAYOUT_SECTIONS)
+// begin, end: set to the [begin, end) range, empty if the section has no properties
+// Returns index of the section in ini->sections, or -1 if there is no such section
+int ini_section_range(ini_parser *ini, const char *name, int *begin, int *end)
+{
+    assert(name);
+    *begin = *end = 0;
+
+    int section = ini_find_section(ini, slice{ (char *)name, (int)strlen(name) });
+    if (section < 0) {
+        return -1;
+    }
+    group_ini_sections(ini);
+    if (ini->sections[section].begin >= 0) {
+        *begin = ini->sections[section].begin;
+        *end = ini->sections[section].end;
+    }
+    return section;
+}
+
+//------------------------------------------------------------------------------
+// Sorted index
+//------------------------------------------------------------------------------
+
+static bool starts_with(slice s, slice prefix)
+{
+    return s.length >= prefix.length && (!prefix.length || !memcmp(s.data, prefix.data, prefix.length));
+}
+
+// (Re)build ini->sorted if properties were added since it was built: every property ini_get() would
+// return, ordered by section, then key
+void update_ini_sorted(ini_parser *ini)
+{
+    assert(!(ini->flags & (INI_NO_PROPERTIES | INI_LAYOUT_COMPACT)));
+
+    int count = (int)ini->properties.size();
+    if (ini->sorted_count == count) {
+        return;
+    }
+    const ini_vector<ini_kv> &properties = ini->properties;
+    ini->sorted.resize(count);
+    for (int i = 0; i < count; i++) {
+        ini->sorted[i] = i;
+    }
+    std::sort(ini->sorted.begin(), ini->sorted.end(), [&](int a, int b) {
+        int c = compare_slices(properties[a].section, properties[b].section);
+        if (!c) {
+            c = compare_slices(properties[a].key, properties[b].key);
+        }
+        return c ? c < 0 : a < b;
+    });
+
+    // Keep the last of each section+key, like the lookup table does
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        const ini_kv &kv = properties[ini->sorted[i]];
+        if (i + 1 < count) {
+            const ini_kv &next = properties[ini->sorted[i + 1]];
+            if (slice_equal(kv.section, next.section) && slice_equal(kv.key, next.key)) {
+                continue;
+            }
+        }
+        ini->sorted[kept++] = ini->sorted[i];
+    }
+    ini->sorted.resize(kept);
+    ini->sorted_count = count;
+}
+
+// Property at position i of a range returned by the ini_*_range() queries
+const ini_kv *ini_sorted_kv(const ini_parser *ini, int i)
+{
+    assert(i >= 0 && i < (int)ini->sorted.size());
+    return &ini->properties[ini->sorted[i]];
+}
+
+// First position in ini->sorted whose property before() is false for, sorted is partitioned by every
+// predicate the queries use
+template <typename F>
+static int sorted_partition(const ini_parser *ini, F &&before)
+{
+    auto it = std::partition_point(ini->sorted.begin(), ini->sorted.end(),
+        [&](int kv) { return before(ini->properties[kv]); });
+    return (int)(it - ini->sorted.begin());
+}
+
+// Properties of [section] whose key starts with prefix (e.g. "cache.") in O(log n), in key order
+// begin, end: set to the [begin, end) range, pass the positions in it to ini_sorted_kv()
+// Returns # of properties in the range
+int ini_prefix_range(ini_parser *ini, slice section, slice prefix, int *begin, int *end)
+{
+    update_ini_sorted(ini);
+    *begin = sorted_partition(ini, [&](const ini_kv &kv) {
+        int c = compare_slices(kv.section, section);
+        return c ? c < 0 : compare_slices(kv.key, prefix) < 0;
+    });
+    *end = sorted_partition(ini, [&](const ini_kv &kv) {
+        int c = compare_slices(kv.section, section);
+        return c ? c < 0 : compare_slices(kv.key, prefix) < 0 || starts_with(kv.key, prefix);
+    });
+    return *end - *begin;
+}
+
+// Properties of [section] with first <= key < last in O(log n), in key order
+// last: nil (data == 0) for no upper bound
+// begin, end: set to the [begin, end) range, pass the positions in it to ini_sorted_kv()
+// Returns # of properties in the range
+int ini_key_range(ini_parser *ini, slice section, slice first, slice last, int *begin, int *end)
+{
+    update_ini_sorted(ini);
+    *begin = sorted_partition(ini, [&](const ini_kv &kv) {
+        int c = compare_slices(kv.section, section);
+        return c ? c < 0 : compare_slices(kv.key, first) < 0;
+    });
+    *end = sorted_partition(ini, [&](const ini_kv &kv) {
+        int c = compare_slices(kv.section, section);
+        return c ? c < 0 : !last.data || compare_slices(kv.key, last) < 0;
+    });
+    if (*end < *begin) {
+        *end = *begin;
+    }
+    return *end - *begin;
+}
+
+// Properties of every section whose name starts with prefix (e.g. "worker." for [worker.*]) in O(log n),
+// ordered by section, then key, so each section's properties are next to each other
+// begin, end: set to the [begin, end) range, pass the positions in it to ini_sorted_kv()
+// Returns # of properties in the range
+int ini_section_prefix_range(ini_parser *ini, slice prefix, int *begin, int *end)
+{
+    update_ini_sorted(ini);
+    *begin = sorted_partition(ini, [&](const ini_kv &kv) { return compare_slices(kv.section, prefix) < 0; });
+    *end = sorted_partition(ini, [&](const ini_kv &kv) {
+        return compare_slices(kv.section, prefix) < 0 || starts_with(kv.section, prefix);
+    });
+    return *end - *begin;
+}
+
+//------------------------------------------------------------------------------
+// Compact layout
+//------------------------------------------------------------------------------
+
+static void store_compact_kv(ini_parser *ini, const ini_kv &kv)
+{
+    ini_compact *c = &ini->compact;
+    if (c->section.empty()) {
+        size_t n = (size_t)ini->estimated_properties;
+        c->section.reserve(n);
+        c->key_offset.reserve(n);
+        c->key_length.reserve(n);
+        c->value_offset.reserve(n);
+        c->value_length.reserve(n);
+    }
+    // Offsets are relative to buf, so a value copied somewhere else can't be stored (see INI_QUOTED_VALUES)
+    assert(!(kv.flags & INI_VALUE_SPILLED));
+    c->section.push_back(ini->section_index);
+    c->key_offset.push_back((uint32_t)(kv.key.data - ini->buf.data));
+    c->key_length.push_back((uint32_t)kv.key.length);
+    c->value_offset.push_back((uint32_t)(kv.value.data - ini->buf.data));
+    c->value_length.push_back((uint32_t)kv.value.length);
+}
+
+// # of properties in the compact layout
+int ini_compact_count(const ini_parser *ini)
+{
+    return (int)ini->compact.section.size();
+}
+
+// Section name of compact property i
+slice ini_compact_section(const ini_parser *ini, int i)
+{
+    return ini->sections[ini->compact.section[i]].name;
+}
+
+// Key of compact property i
+slice ini_compact_key(const ini_parser *ini, int i)
+{
+    return slice{ ini->buf.data + ini->compact.key_offset[i], (int)ini->compact.key_length[i] };
+}
+
+// Value of compact property i
+slice ini_compact_value(const ini_parser *ini, int i)
+{
+    return slice{ ini->buf.data + ini->compact.value_offset[i], (int)ini->compact.value_length[i] };
+}
+
+//------------------------------------------------------------------------------
+// Typed values
+//------------------------------------------------------------------------------
+
+// The ini_parse_*() conversions work straight on the slice (no nil terminator, no copy, no allocation) and
+// don't care about the C locale. The whole slice has to be the value, or they fail.
+// Returns 0 on success, -1 if s isn't a valid value of that type (value is left alone then)
+
+// Decimal, or hex with a 0x prefix, with an optional sign
+int ini_parse_int(slice s, int64_t *value)
+{
+    const char *p = s.data;
+    const char *end = s.data + s.length;
+    bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) {
+        p++;
+    }
+    int base = 10;
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        base = 16;
+        p += 2;
+    }
+    if (p == end || *p == '-' || *p == '+') {
+        return -1;
+    }
+
+    uint64_t magnitude = 0;
+    std::from_chars_result r = std::from_chars(p, end, magnitude, base);
+    if (r.ec != std::errc() || r.ptr != end) {
+        return -1;
+    }
+    uint64_t limit = negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+    if (magnitude > limit) {
+        return -1;
+    }
+    *value = negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+    return 0;
+}
+
+// Decimal or scientific notation with an optional sign, also inf and nan
+int ini_parse_double(slice s, double *value)
+{
+    const char *p = s.data;
+    const char *end = s.data + s.length;
+    // from_chars() takes a '-' but not a '+', and the sign it takes mustn't follow ours
+    bool plus = p < end && *p == '+';
+    if (plus) {
+        p++;
+    }
+    if (p == end || *p == '+' || (plus && *p == '-')) {
+        return -1;
+    }
+    double d = 0;
+    std::from_chars_result r = std::from_chars(p, end, d);
+    if (r.ec != std::errc() || r.ptr != end) {
+        return -1;
+    }
+    *value = d;
+    return 0;
+}
+
+// Case insensitive slice == word (word is lower case)
+static bool slice_is(slice s, const char *word)
+{
+    int i = 0;
+    for (; i < s.length && word[i]; i++) {
+        char c = s.data[i];
+        if (c >= 'A' && c <= 'Z') {
+            c = (char)(c - 'A' + 'a');
+        }
+        if (c != word[i]) {
+            return false;
+        }
+    }
+    return i == s.length && !word[i];
+}
+
+// true/false, yes/no, on/off or 1/0, case insensitive
+int ini_parse_bool(slice s, bool *value)
+{
+    if (slice_is(s, "true") || slice_is(s, "yes") || slice_is(s, "on") || slice_is(s, "1")) {
+        *value = true;
+    } else if (slice_is(s, "false") || slice_is(s, "no") || slice_is(s, "off") || slice_is(s, "0")) {
+        *value = false;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+// Leading non-negative number of [*p, end), advancing *p past it
+static bool parse_number(const char **p, const char *end, double *value)
+{
+    if (*p == end || !((**p >= '0' && **p <= '9') || **p == '.')) {
+        return false;
+    }
+    std::from_chars_result r = std::from_chars(*p, end, *value, std::chars_format::fixed);
+    if (r.ec != std::errc()) {
+        return false;
+    }
+    *p = r.ptr;
+    return true;
+}
+
+// Leading unit of [*p, end) (letters only), advancing *p past it
+static slice parse_unit(const char **p, const char *end)
+{
+    const char *begin = *p;
+    while (*p < end && ((**p >= 'a' && **p <= 'z') || (**p >= 'A' && **p <= 'Z'))) {
+        (*p)++;
+    }
+    return slice{ (char *)begin, (int)(*p - begin) };
+}
+
+// One or more number+unit pairs like 1h30m or 1.5s, units are ns, us, ms, s, m, h and d. A bare number is
+// seconds.
+int ini_parse_duration(slice s, int64_t *nanoseconds)
+{
+    const char *p = s.data;
+    const char *end = s.data + s.length;
+    double total = 0;
+    do {
+        double number = 0;
+        if (!parse_number(&p, end, &number)) {
+            return -1;
+        }
+        slice unit = parse_unit(&p, end);
+        double scale;
+        if (!unit.length && p == end && total == 0) scale = 1e9;
+        else if (slice_is(unit, "ns")) scale = 1;
+        else if (slice_is(unit, "us")) scale = 1e3;
+        else if (slice_is(unit, "ms")) scale = 1e6;
+        else if (slice_is(unit, "s")) scale = 1e9;
+        else if (slice_is(unit, "m")) scale = 60e9;
+        else if (slice_is(unit, "h")) scale = 3600e9;
+        else if (slice_is(unit, "d")) scale = 86400e9;
+        else return -1;
+        total += number * scale;
+    } while (p < end);
+
+    if (!(total < 9.2e18)) {
+        return -1;
+    }
+    *nanoseconds = (int64_t)(total + 0.5);
+    return 0;
+}
+
+// Number with an optional unit, b, k/ki/kib (1024), kb (1000), and the same for m, g and t. Case insensitive,
+// spaces allowed between the number and unit. A bare number is bytes.
+int ini_parse_size(slice s, uint64_t *bytes)
+{
+    const char *p = s.data;
+    const char *end = s.data + s.length;
+    double number = 0;
+    if (!parse_number(&p, end, &number)) {
+        return -1;
+    }
+    // Integers are converted exactly, only fractions ("1.5g") go through the double
+    uint64_t whole = 0;
+    std::from_chars_result r = std::from_chars(s.data, end, whole);
+    bool exact = r.ec == std::errc() && r.ptr == p;
+
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    slice unit = parse_unit(&p, end);
+    if (p != end) {
+        return -1;
+    }
+    static const struct { const char *binary[3]; const char *decimal; } units[] = {
+        { { "k", "ki", "kib" }, "kb" },
+        { { "m", "mi", "mib" }, "mb" },
+        { { "g", "gi", "gib" }, "gb" },
+        { { "t", "ti", "tib" }, "tb" },
+    };
+    uint64_t scale = 1;
+    if (unit.length && !slice_is(unit, "b")) {
+        scale = 0;
+        uint64_t binary = 1;
+        uint64_t decimal = 1;
+        for (const auto &u : units) {
+            binary *= 1024;
+            decimal *= 1000;
+            if (slice_is(unit, u.binary[0]) || slice_is(unit, u.binary[1]) || slice_is(unit, u.binary[2])) {
+                scale = binary;
+            } else if (slice_is(unit, u.decimal)) {
+                scale = decimal;
+            }
+        }
+        if (!scale) {
+            return -1;
+        }
+    }
+
+    if (exact) {
+        if (whole > UINT64_MAX / scale) {
+            return -1;
+        }
+        *bytes = whole * scale;
+    } else {
+        double total = number * (double)scale;
+        if (!(total < 1.8e19)) {
+            return -1;
+        }
+        *bytes = (uint64_t)(total + 0.5);
+    }
+    return 0;
+}
+
+// Common part of the typed getters: find the property, then hand back its cached conversion if there is one
+// Returns index of the property (-1 if there's no such property), *cached is set if INI_CACHE_TYPED
+// already has a type conversion for it
+static int typed_find(ini_parser *ini, const char *section, const char *key, int type, ini_typed **cached)
+{
+    assert(section);
+    assert(key);
+    *cached = 0;
+    int kv = ini_find(ini, slice{ (char *)section, (int)strlen(section) }, slice{ (char *)key, (int)strlen(key) });
+    if (kv >= 0 && (ini->flags & INI_CACHE_TYPED)) {
+        if (ini->typed.size() < ini->properties.size()) {
+            ini->typed.resize(ini->properties.size(), ini_typed{});
+        }
+        if (ini->typed[kv].type == type) {
+            *cached = &ini->typed[kv];
+        }
+    }
+    return kv;
+}
+
+// Remember a successful conversion of property kv, if INI_CACHE_TYPED is set
+static void typed_store(ini_parser *ini, int kv, int type, const ini_typed &value)
+{
+    if (ini->flags & INI_CACHE_TYPED) {
+        ini->typed[kv] = value;
+        ini->typed[kv].type = type;
+    }
+}
+
+// Typed versions of ini_get(), converting the value with the matching ini_parse_*()
+// Returns 0 on success, -1 if there is no such property, -2 if its value isn't valid for the type (value is
+// left alone unless it returns 0, so it can hold a default)
+int ini_get_int(ini_parser *ini, const char *section, const char *key, int64_t *value)
+{
+    ini_typed *cached;
+    int kv = typed_find(ini, section, key, INI_TYPE_INT, &cached);
+    if (cached) {
+        *value = cached->i;
+        return 0;
+    }
+    if (kv < 0) {
+        return -1;
+    }
+    ini_typed typed{};
+    if (ini_parse_int(ini->properties[kv].value, &typed.i) < 0) {
+        return -2;
+    }
+    typed_store(ini, kv, INI_TYPE_INT, typed);
+    *value = typed.i;
+    return 0;
+}
+
+int ini_get_double(ini_parser *ini, const char *section, const char *key, double *value)
+{
+    ini_typed *cached;
+    int kv = typed_find(ini, section, key, INI_TYPE_DOUBLE, &cached);
+    if (cached) {
+        *value = cached->d;
+        return 0;
+    }
+    if (kv < 0) {
+        return -1;
+    }
+    ini_typed typed{};
+    if (ini_parse_double(ini->properties[kv].value, &typed.d) < 0) {
+        return -2;
+    }
+    typed_store(ini, kv, INI_TYPE_DOUBLE, typed);
+    *value = typed.d;
+    return 0;
+}
+
+int ini_get_bool(ini_parser *ini, const char *section, const char *key, bool *value)
+{
+    ini_typed *cached;
+    int kv = typed_find(ini, section, key, INI_TYPE_BOOL, &cached);
+    if (cached) {
+        *value = cached->b;
+        return 0;
+    }
+    if (kv < 0) {
+        return -1;
+    }
+    ini_typed typed{};
+    if (ini_parse_bool(ini->properties[kv].value, &typed.b) < 0) {
+        return -2;
+    }
+    typed_store(ini, kv, INI_TYPE_BOOL, typed);
+    *value = typed.b;
+    return 0;
+}
+
+int ini_get_duration(ini_parser *ini, const char *section, const char *key, int64_t *nanoseconds)
+{
+    ini_typed *cached;
+    int kv = typed_find(ini, section, key, INI_TYPE_DURATION, &cached);
+    if (cached) {
+        *nanoseconds = cached->i;
+        return 0;
+    }
+    if (kv < 0) {
+        return -1;
+    }
+    ini_typed typed{};
+    if (ini_parse_duration(ini->properties[kv].value, &typed.i) < 0) {
+        return -2;
+    }
+    typed_store(ini, kv, INI_TYPE_DURATION, typed);
+    *nanoseconds = typed.i;
+    return 0;
+}
+
+int ini_get_size(ini_parser *ini, const char *section, const char *key, uint64_t *bytes)
+{
+    ini_typed *cached;
+    int kv = typed_find(ini, section, key, INI_TYPE_SIZE, &cached);
+    if (cached) {
+        *bytes = cached->u;
+        return 0;
+    }
+    if (kv < 0) {
+        return -1;
+    }
+    ini_typed typed{};
+    if (ini_parse_size(ini->properties[kv].value, &typed.u) < 0) {
+        return -2;
+    }
+    typed_store(ini, kv, INI_TYPE_SIZE, typed);
+    *bytes = typed.u;
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Stats
+//------------------------------------------------------------------------------
+
+#ifdef INI_STATS
+thread_local size_t ini_held_bytes;
+thread_local size_t ini_peak_bytes;
+
+static ini_trace stats_trace;
+
+// Install hooks that get told about every parse and file load (nil removes them). They're shared by every
+// thread and not synchronized, so set them before parsing anything.
+void ini_set_trace(const ini_trace *trace)
+{
+    stats_trace = trace ? *trace : ini_trace{};
+}
+
+static int64_t stats_now()
+{
+    using namespace std::chrono;
+    return (int64_t)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Reports the enclosing block as a trace span
+struct trace_scope {
+    const char *span;
+
+    explicit trace_scope(const char *span) : span(span) {
+        if (stats_trace.begin) {
+            stats_trace.begin(stats_trace.user, span);
+        }
+    }
+    ~trace_scope() {
+        if (stats_trace.end) {
+            stats_trace.end(stats_trace.user, span);
+        }
+    }
+};
+
+// Adds whatever the enclosing parse call does to ini->stats (unless it's running inside another parse of
+// the same parser, then the outer one counts it), and reports it as a trace span
+struct stats_scope {
+    trace_scope trace;
+    ini_parser *ini;
+    int cursor;
+    int line;
+    int64_t start;
+    int64_t emit_ns;
+    size_t held;
+    size_t peak;
+
+    stats_scope(ini_parser *ini, const char *span)
+        : trace(span), ini(ini), cursor(0), line(0), start(0), emit_ns(0), held(0), peak(0) {
+        if (ini->stats.depth++) {
+            return;
+        }
+        cursor = ini->cursor;
+        line = ini->line;
+        emit_ns = ini->stats.emit_ns;
+        held = ini_held_bytes;
+        peak = ini_peak_bytes;
+        ini_peak_bytes = ini_held_bytes;
+        start = stats_now();
+    }
+    ~stats_scope() {
+        if (--ini->stats.depth) {
+            return;
+        }
+        ini_parse_stats &stats = ini->stats;
+        stats.tokenize_ns += (stats_now() - start) - (stats.emit_ns - emit_ns);
+        stats.bytes += ini->cursor - cursor;
+        stats.lines += ini->line - line;
+        stats.estimated_properties = ini->estimated_properties;
+        size_t used = ini_peak_bytes > held ? ini_peak_bytes - held : 0;
+        if (used > stats.peak_bytes) {
+            stats.peak_bytes = used;
+        }
+        if (peak > ini_peak_bytes) {
+            ini_peak_bytes = peak;
+        }
+    }
+};
+
+// Adds the time the enclosing block takes to ini->stats.emit_ns
+struct emit_timer {
+    ini_parser *ini;
+    int64_t start;
+
+    explicit emit_timer(ini_parser *ini) : ini(ini), start(stats_now()) {}
+    ~emit_timer() {
+        ini->stats.emit_ns += stats_now() - start;
+    }
+};
+
+#define INI_STAT(statement) statement
+#define INI_STATS_SCOPE(ini, span) stats_scope stats_scope_(ini, span)
+#define INI_TRACE_SCOPE(span) trace_scope trace_scope_(span)
+#else
+void ini_set_trace(const ini_trace *)
+{
+}
+
+#define INI_STAT(statement)
+#define INI_STATS_SCOPE(ini, span)
+#define INI_TRACE_SCOPE(span)
+#endif
+
+//------------------------------------------------------------------------------
+// Parser
+//------------------------------------------------------------------------------
+
+// Length of the UTF-8 byte order mark buf starts with, 0 if it doesn't have one
+static int utf8_bom_length(buffer buf)
+{
+    return buf.length >= 3 && !memcmp(buf.data, "\xef\xbb\xbf", 3) ? 3 : 0;
+}
+
+// Set up parser to read buf, skipping its UTF-8 byte order mark if it has one. A parser that was used
+// before starts over: everything from the last parse is dropped, only its options (flags, quiet, writable,
+// visitor) and the strings arena (values copied out of an old buffer may still be in use) are kept.
+// arena: if given, properties and all of the parser's side tables are allocated from it instead of the
+//        heap, so they're all released at once by reset_arena()/free_arena()
+void init_ini(ini_parser *ini, buffer buf, ini_arena *arena) {
+    ini_parser fresh{};
+    fresh.quiet = ini->quiet;
+    fresh.writable = ini->writable;
+    fresh.flags = ini->flags;
+    fresh.visitor = ini->visitor;
+    fresh.strings = ini->strings;
+    *ini = std::move(fresh);
+
+    ini->buf = buf;
+    ini->cursor = utf8_bom_length(buf);
+    ini->line = 1;
+    ini->scan = ini_best_scanner();
+    ini->arena = arena;
+    ini->properties = ini_vector<ini_kv>(ini_allocator<ini_kv>(arena));
+    ini->index.offsets = ini_vector<int>(ini_allocator<int>(arena));
+    ini->lookup.slots = ini_vector<ini_slot>(ini_allocator<ini_slot>(arena));
+    ini->sorted = ini_vector<int>(ini_allocator<int>(arena));
+    ini->sections = ini_vector<ini_section>(ini_allocator<ini_section>(arena));
+    ini->section_properties = ini_vector<ini_section_kv>(ini_allocator<ini_section_kv>(arena));
+    ini->section_table.slots = ini_vector<ini_slot>(ini_allocator<ini_slot>(arena));
+    ini->sections_grouped = true;
+    ini->compact.section = ini_vector<uint32_t>(ini_allocator<uint32_t>(arena));
+    ini->compact.key_offset = ini_vector<uint32_t>(ini_allocator<uint32_t>(arena));
+    ini->compact.key_length = ini_vector<uint32_t>(ini_allocator<uint32_t>(arena));
+    ini->compact.value_offset = ini_vector<uint32_t>(ini_allocator<uint32_t>(arena));
+    ini->compact.value_length = ini_vector<uint32_t>(ini_allocator<uint32_t>(arena));
+    ini->typed = ini_vector<ini_typed>(ini_allocator<ini_typed>(arena));
+    ini->lazy.sections = ini_vector<ini_lazy_section>(ini_allocator<ini_lazy_section>(arena));
+    ini->lazy.table.slots = ini_vector<ini_slot>(ini_allocator<ini_slot>(arena));
+    ini->errors = ini_vector<ini_error>(ini_allocator<ini_error>(arena));
+
+    // Whichever layouts end up being used get reserved to this on their first property, so they never have
+    // to grow (and copy) while parsing
+    ini->estimated_properties = estimate_ini_properties(ini);
+}
+
+// Quick pass over the buffer to bound the # of properties in it from above. Every property needs its own
+// '=' and its own line, so there can't be more properties than either of those.
+int estimate_ini_properties(const ini_parser *ini)
+{
+    ini_byte_counts counts{};
+    ini->scan->count(ini->buf.data + ini->cursor, ini->buf.data + ini->buf.length, &counts);
+    int lines = counts.lf + counts.cr + 1;
+    return counts.eq < lines ? counts.eq : lines;
+}
+
+// Record a parse error at offset on the current line in ini->error (and ini->errors), then pass it to the
+// visitor or print it, unless the parser has been told to keep quiet or is collecting errors
+// Returns what the parse function should return: INI_SKIPPED to carry on with INI_RECOVER, otherwise -1
+static int report_error(ini_parser *ini, int offset, int code, const char *msg)
+{
+    const char *data = ini->buf.data;
+    int line_begin = offset;
+    while (line_begin > 0 && data[line_begin - 1] != '\n' && data[line_begin - 1] != '\r') {
+        line_begin--;
+    }
+    int line_end = (int)(ini->scan->find_eol(data + offset, data + ini->buf.length) - data);
+
+    ini_error error{};
+    error.code = code;
+    error.msg = msg;
+    error.line = ini->line;
+    error.column = offset - line_begin + 1;
+    error.offset = offset;
+    error.text = slice{ ini->buf.data + line_begin, line_end - line_begin };
+    if (!ini->error.code) {
+        ini->error = error;
+    }
+
+    bool recover = (ini->flags & INI_RECOVER) != 0;
+    if (recover) {
+        ini->errors.push_back(error);
+    }
+    if (ini->visitor.error) {
+        ini->visitor.error(ini->visitor.user, ini->line, msg);
+    } else if (!ini->quiet && !recover) {
+        fprintf(stderr, "[line %d:%d] %s\n", error.line, error.column, msg);
+    }
+    return recover ? INI_SKIPPED : -1;
+}
+
+// # of lines parse_ini() counts in [begin, end), \r\n counts once
+static int count_lines(const char *begin, const char *end)
+{
+    int lines = 0;
+    for (const char *p = begin; p < end; p++) {
+        if (*p == '\n' || (*p == '\r' && (p + 1 == end || p[1] != '\n'))) {
+            lines++;
+        }
+    }
+    return lines;
+}
+
+// INI_VALIDATE_UTF8: check buf is valid UTF-8 from ini->utf8_checked up to end, reporting each line that
+// isn't (and skipping the rest of it). If end is in the middle of buf it's moved back to the start of the
+// sequence it cuts through, which is checked next time.
+// *base, *line: some offset at or before utf8_checked and its line #, to number the errors. Moved along
+//               with them.
+// Returns 0 if it's all valid (or INI_RECOVER reported every bad line), otherwise report_error()'s result
+static int check_utf8(ini_parser *ini, int end, int *base, int *line)
+{
+    const char *data = ini->buf.data;
+    if (ini->utf8_checked < *base) {
+        ini->utf8_checked = *base;
+    }
+    if (end < ini->buf.length) {
+        int limit = end - 3 > ini->utf8_checked ? end - 3 : ini->utf8_checked;
+        while (end > limit && (data[end] & 0xc0) == 0x80) {
+            end--;
+        }
+    }
+    while (ini->utf8_checked < end) {
+        int bad = (int)(ini->scan->validate_utf8(data + ini->utf8_checked, data + end) - data);
+        if (bad == end) {
+            ini->utf8_checked = end;
+            break;
+        }
+        *line += count_lines(data + *base, data + bad);
+        *base = bad;
+        int parse_line = ini->line;
+        ini->line = *line;
+        int err = report_error(ini, bad, INI_ERROR_UTF8, "Invalid UTF-8 sequence");
+        ini->line = parse_line;
+        ini->utf8_checked = (int)(ini->scan->find_eol(data + bad, data + ini->buf.length) - data);
+        if (err != INI_SKIPPED) {
+            return err;
+        }
+    }
+    return 0;
+}
+
+int parse_ini(ini_parser *ini)
+{
+    INI_STATS_SCOPE(ini, "parse_ini");
+    size_t errors = ini->errors.size();
+    if ((ini->flags & INI_VALIDATE_UTF8) && ini->utf8_checked < ini->buf.length) {
+        int base = ini->cursor;
+        int line = ini->line;
+        int err = check_utf8(ini, ini->buf.length, &base, &line);
+        if (err) {
+            return err;
+        }
+    }
+    while (ini->cursor < ini->buf.length) {
+        switch (ini->buf.data[ini->cursor]) {
+            case '\r': {
+                if (ini->cursor < ini->buf.length - 1 && ini->buf.data[ini->cursor + 1] == '\n') {
+                    // handle Windows newlines (\r\n) by just ignoring the \r and let the \n later
+                    // increment the line count
+                } else if (ini->partial && ini->cursor == ini->buf.length - 1) {
+                    // can't tell if this is \r\n until we see the next byte
+                    return INI_NEED_MORE;
+                } else {
+                    // keep track of line # for pretty error messages
+                    ini->line++;
+                }
+                break;
+            }
+            case '\n': {
+                // keep track of line # for pretty error messages
+                ini->line++;
+                break;
+            }
+            case ' ': case '\t': {
+                // ignore whitespace characters
+                break;
+            }
+            case ';': {
+                // discard comments, this stops on the newline so the loop still counts it
+                int comment_begin = ini->cursor;
+                discard_comment(ini);
+                if (ini->partial && ini->cursor == ini->buf.length) {
+                    ini->cursor = comment_begin;
+                    return INI_NEED_MORE;
+                }
+                INI_STAT(ini->stats.comment_bytes += ini->cursor - comment_begin);
+                continue;
+            }
+            case '[': {
+                // read section header, check for errors
+                int err = parse_section_header(ini);
+                if (err == INI_SKIPPED) {
+                    discard_comment(ini);
+                    continue;
+                }
+                if (err) {
+                    return err;
+                }
+                break;
+            }
+            default: {
+                // parse key=value line, this stops on the newline so the loop still counts it
+                int err = parse_kv(ini);
+                if (err == INI_SKIPPED) {
+                    discard_comment(ini);
+                    continue;
+                }
+                if (err) {
+                    return err;
+                }
+                continue;
+            }
+        }
+        ini->cursor++;
+    }
+    return ini->errors.size() != errors ? -1 : 0;
+}
+
+void discard_whitespace(ini_parser *ini)
+{
+    while (ini->cursor < ini->buf.length) {
+        switch (ini->buf.data[ini->cursor]) {
+            case ' ': case '\t': {
+                // skip whitespace
+                break;
+            }
+            default: {
+                // we found something interesting, return so it can be parsed by someone
+                return;
+            }
+        }
+        ini->cursor++;
+    }
+}
+
+void discard_comment(ini_parser *ini)
+{
+    // Discard everything until the next newline
+    const char *begin = ini->buf.data;
+    const char *end = begin + ini->buf.length;
+    ini->cursor = (int)(ini->scan->find_eol(begin + ini->cursor, end) - begin);
+}
+
+// Returns offset just past the last non-whitespace character in [begin, end), or begin if it's all whitespace
+static int trim_whitespace_right(const char *data, int begin, int end)
+{
+    while (end > begin && (data[end - 1] == ' ' || data[end - 1] == '\t')) {
+        end--;
+    }
+    return end;
+}
+
+static bool visiting(const ini_parser *ini)
+{
+    return ini->visitor.kv || ini->visitor.section;
+}
+
+// Hand a finished property to the visitor, or store it in every layout the parser's flags ask for
+// Returns 0, or INI_STOPPED if the visitor wants to stop
+static int store_kv(ini_parser *ini, const ini_kv &kv)
+{
+    INI_STAT(emit_timer timer(ini));
+    INI_STAT(ini->stats.properties++);
+    if (visiting(ini)) {
+        if (ini->visitor.kv && ini->visitor.kv(ini->visitor.user, &kv)) {
+            return INI_STOPPED;
+        }
+        return 0;
+    }
+
+    if (!(ini->flags & INI_NO_PROPERTIES)) {
+        if (ini->properties.empty()) {
+            ini->properties.reserve(ini->estimated_properties);
+        }
+        INI_STAT(size_t capacity = ini->properties.capacity());
+        ini->properties.push_back(kv);
+        INI_STAT(ini->stats.reallocations += capacity && ini->properties.capacity() != capacity);
+
+        if (ini->flags & INI_BUILD_LOOKUP) {
+            update_ini_lookup(ini);
+        }
+    }
+    if ((ini->flags & (INI_LAYOUT_SECTIONS | INI_LAYOUT_COMPACT)) && ini->sections.empty()) {
+        intern_section(ini, slice{});
+    }
+    if (ini->flags & INI_LAYOUT_SECTIONS) {
+        store_section_kv(ini, kv);
+    }
+    if (ini->flags & INI_LAYOUT_COMPACT) {
+        store_compact_kv(ini, kv);
+    }
+    return 0;
+}
+
+// Every parse loop calls this when it enters a new [section]
+// Returns 0, or INI_STOPPED if the visitor wants to stop
+static int emit_section(ini_parser *ini, slice name)
+{
+    INI_STAT(emit_timer timer(ini));
+    INI_STAT(ini->stats.sections++);
+    ini->section = name;
+    if (visiting(ini)) {
+        if (ini->visitor.section && ini->visitor.section(ini->visitor.user, name)) {
+            return INI_STOPPED;
+        }
+        return 0;
+    }
+
+    if (ini->flags & (INI_LAYOUT_SECTIONS | INI_LAYOUT_COMPACT)) {
+        ini->section_index = intern_section(ini, name);
+    }
+    if (ini->flags & INI_RECORD_HEADERS) {
+        if (ini->properties.empty()) {
+            ini->properties.reserve(ini->estimated_properties);
+        }
+        ini->properties.push_back(ini_kv{ name, slice{}, slice{}, 0 });
+    }
+    return 0;
+}
+
+// Check that every escape sequence of a quoted value is one unescape_value() knows, before anything gets
+// written over the line
+static bool valid_escapes(const char *in, int length)
+{
+    for (int i = 0; i < length; i++) {
+        if (in[i] == '\\') {
+            switch (in[++i]) {
+                case '\\': case '"': case '\'': case 'n': case 'r': case 't': case '0': break;
+                default: return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Replace the escape sequences of a quoted value, writing the result to out (which may be in, it never
+// gets longer). The escapes must have passed valid_escapes(). Returns length of the result.
+static int unescape_value(const char *in, int length, char *out)
+{
+    int n = 0;
+    for (int i = 0; i < length; i++) {
+        char c = in[i];
+        if (c == '\\') {
+            switch (in[++i]) {
+                case '\\': c = '\\'; break;
+                case '"':  c = '"';  break;
+                case '\'': c = '\''; break;
+                case 'n':  c = '\n'; break;
+                case 'r':  c = '\r'; break;
+                case 't':  c = '\t'; break;
+                case '0':  c = '\0'; break;
+                default:   assert(!"unescape_value: unchecked escape"); break;
+            }
+        }
+        out[n++] = c;
+    }
+    return n;
+}
+
+// Find the value in begin..end (everything after the '=' and leading whitespace, up to the newline) for
+// INI_QUOTED_VALUES. A value that starts with '"' runs until the closing '"', and only whitespace or a ;
+// comment can follow it. Anything else runs until the first ';' and has its trailing whitespace trimmed.
+// Values are slices into buf unless they're quoted and have escapes in them, those get unescaped into buf
+// (if it's writable) or into the arena, see INI_VALUE_*.
+// Returns 0 on success, negative error code on failure
+static int parse_value(ini_parser *ini, int begin, int end, ini_kv *kv)
+{
+    char *data = ini->buf.data;
+    if (begin == end || data[begin] != '"') {
+        int value_end = (int)(ini->scan->find_char(data + begin, data + end, ';') - data);
+        INI_STAT(ini->stats.comment_bytes += end - value_end);
+        value_end = trim_whitespace_right(data, begin, value_end);
+        if (value_end == begin) {
+            return report_error(ini, begin, INI_ERROR_NO_VALUE, "Expected value after '=', encountered EOF instead");
+        }
+        kv->value = slice{ data + begin, value_end - begin };
+        return 0;
+    }
+
+    // Common case is no backslashes before the first '"', which is then the closing one
+    int open = begin + 1;
+    int close = (int)(ini->scan->find_char(data + open, data + end, '"') - data);
+    bool escaped = memchr(data + open, '\\', close - open) != 0;
+    if (escaped) {
+        close = open;
+        while (close < end && data[close] != '"') {
+            close += data[close] == '\\' ? 2 : 1;
+        }
+    }
+    if (close >= end) {
+        return report_error(ini, begin, INI_ERROR_QUOTE_EOL, "Expected '\"' before end of line");
+    }
+    int rest = close + 1;
+    while (rest < end && (data[rest] == ' ' || data[rest] == '\t')) {
+        rest++;
+    }
+    if (rest < end && data[rest] != ';') {
+        return report_error(ini, rest, INI_ERROR_AFTER_QUOTE, "Expected ';' or end of line after closing '\"'");
+    }
+    INI_STAT(ini->stats.comment_bytes += end - rest);
+
+    kv->flags = INI_VALUE_QUOTED;
+    kv->value = slice{ data + open, close - open };
+    if (!escaped) {
+        return 0;
+    }
+
+    if (!valid_escapes(data + open, close - open)) {
+        return report_error(ini, begin, INI_ERROR_ESCAPE, "Unknown escape sequence in quoted value");
+    }
+    char *out = data + open;
+    if (ini->writable) {
+        kv->flags |= INI_VALUE_IN_PLACE;
+    } else {
+        out = (char *)arena_alloc(ini->arena ? ini->arena : &ini->strings, close - open, 1);
+        if (!out) {
+            throw std::bad_alloc();
+        }
+        kv->flags |= INI_VALUE_SPILLED;
+    }
+    kv->value.data = out;
+    kv->value.length = unescape_value(data + open, close - open, out);
+    return 0;
+}
+
+// Common tail of every parse loop once it has found where the key and value are
+// key_begin..key_end    : key up to (not including) the '='
+// value_begin..value_end: value after any leading whitespace, up to (not including) the newline
+// Trims trailing whitespace off both (or finds the value with parse_value()), then stores the property
+static int emit_kv(ini_parser *ini, int key_begin, int key_end, int value_begin, int value_end)
+{
+    const char *data = ini->buf.data;
+
+    // Ignore whitespace after key, before '='
+    key_end = trim_whitespace_right(data, key_begin, key_end);
+    if (key_end == key_begin) {
+        return report_error(ini, key_begin, INI_ERROR_NO_KEY, "Expected key before '='");
+    }
+
+    ini_kv kv{};
+    kv.section = ini->section;
+    kv.key.data = ini->buf.data + key_begin;
+    kv.key.length = key_end - key_begin;
+
+    if (ini->flags & INI_QUOTED_VALUES) {
+        int err = parse_value(ini, value_begin, value_end, &kv);
+        if (err) {
+            return err;
+        }
+        return store_kv(ini, kv);
+    }
+
+    // Ignore whitespace after value, before newline
+    value_end = trim_whitespace_right(data, value_begin, value_end);
+    if (value_end == value_begin) {
+        return report_error(ini, value_begin, INI_ERROR_NO_VALUE, "Expected value after '=', encountered EOF instead");
+    }
+
+    kv.value.data = ini->buf.data + value_begin;
+    kv.value.length = value_end - value_begin;
+    return store_kv(ini, kv);
+}
+
+int parse_section_header(ini_parser *ini)
+{
+    // Discard '['
+    ini->cursor++;
+
+    const char *data = ini->buf.data;
+    int section_begin = ini->cursor;
+    int section_end = (int)(ini->scan->find_char(data + section_begin, data + ini->buf.length, ']') - data);
+
+    if (section_end == ini->buf.length) {
+        if (ini->partial) {
+            ini->cursor = section_begin - 1;
+            return INI_NEED_MORE;
+        }
+        return report_error(ini, section_begin - 1, INI_ERROR_SECTION_EOF, "Expected ']', encountered EOF instead");
+    }
+
+    // End of section header, update current section info in the reader
+    int err = emit_section(ini, slice{ ini->buf.data + section_begin, section_end - section_begin });
+    if (err) {
+        ini->cursor = section_end + 1;
+        return err;
+    }
+
+    // Leave cursor on the ']', parse_ini steps over it
+    ini->cursor = section_end;
+    return 0;
+}
+
+
+int parse_kv(ini_parser *ini)
+{
+    // Allowed whitespace:
+    //  key  =  value
+    // ^1  ^2  ^3    ^4
+    // 1: leading whitespace
+    // 2: whitespace before '='
+    // 3: whitespace after '='
+    // 4: trailing whitespace before newline
+    // 2 and 4 are trimmed off after the scanner finds where the key/value ends
+
+    const char *data = ini->buf.data;
+    const char *end = data + ini->buf.length;
+
+    // discard any whitespace before key
+    discard_whitespace(ini);
+
+    // Read key, it extends up until the '='
+    int key_begin = ini->cursor;
+    int key_end = (int)(ini->scan->find_eq_eol(data + key_begin, end) - data);
+
+    if (key_end == ini->buf.length) {
+        if (ini->partial) {
+            ini->cursor = key_begin;
+            return INI_NEED_MORE;
+        }
+        return report_error(ini, key_begin, INI_ERROR_KEY_EOF, "Expected '=' after key, encountered EOF instead");
+    }
+    if (data[key_end] != '=') {
+        // Wtf? Why is there a newline before the equal sign??
+        return report_error(ini, key_end, INI_ERROR_KEY_EOL, "Expected '=', encountered EOL instead");
+    }
+
+    // Discard '='
+    ini->cursor = key_end + 1;
+
+    // discard any whitespace before value
+    discard_whitespace(ini);
+
+    // Read value, it extends up until the newline (or EOF). Leave the cursor on the newline, parse_ini
+    // needs to see it to keep the line count right.
+    int value_begin = ini->cursor;
+    int value_end = (int)(ini->scan->find_eol(data + value_begin, end) - data);
+    if (value_end == ini->buf.length && ini->partial) {
+        ini->cursor = key_begin;
+        return INI_NEED_MORE;
+    }
+    ini->cursor = value_end;
+
+    return emit_kv(ini, key_begin, key_end, value_begin, value_end);
+}
+
+// Phase 1 of the indexed parser: record the offset of every structural character in ini->index. With
+// INI_VALIDATE_UTF8 the rest of buf is validated as well, a few KB at a time right before they're indexed so
+// the bytes are only brought into cache once.
+// Returns 0 on success, or check_utf8()'s error
+int index_ini(ini_parser *ini)
+{
+    INI_STATS_SCOPE(ini, "index_ini");
+    const char *data = ini->buf.data;
+    int length = ini->buf.length;
+    ini_vector<int> &offsets = ini->index.offsets;
+    const int utf8_stride = 4096;
+    bool validate = (ini->flags & INI_VALIDATE_UTF8) && ini->utf8_checked < length;
+    int utf8_base = ini->cursor;
+    int utf8_line = ini->line;
+
+    // Start with a guess of one structural per 8 bytes and double whenever a block might not fit
+    offsets.resize(64 + length / 8);
+    size_t count = 0;
+
+    for (int block = 0; block < length; block += 64) {
+        if (validate && block % utf8_stride == 0 && block + utf8_stride > ini->cursor) {
+            int stride_end = length - block > utf8_stride ? block + utf8_stride : length;
+            int err = check_utf8(ini, stride_end, &utf8_base, &utf8_line);
+            if (err) {
+                offsets.clear();
+                return err;
+            }
+        }
+
+        uint64_t mask;
+        if (length - block >= 64) {
+            mask = ini->scan->classify64(data + block);
+        } else {
+            // Pad the tail with nils, they're never structural
+            char tail[64] = {};
+            memcpy(tail, data + block, length - block);
+            mask = ini->scan->classify64(tail);
+        }
+
+        if (offsets.size() - count < 64) {
+            offsets.resize(offsets.size() * 2);
+        }
+        int *out = offsets.data() + count;
+        while (mask) {
+            *out++ = block + ini_ctz64(mask);
+            mask &= mask - 1;
+        }
+        count = out - offsets.data();
+    }
+
+    offsets.resize(count);
+    offsets.push_back(length);
+    return 0;
+}
+
+// Phase 2 of the indexed parser: hop between the structural characters found by index_ini() instead of
+// scanning bytes. Produces exactly the same properties and errors as parse_ini().
+// Builds the index first if index_ini() hasn't been called yet.
+int parse_ini_indexed(ini_parser *ini)
+{
+    INI_STATS_SCOPE(ini, "parse_ini_indexed");
+    size_t errors = ini->errors.size();
+    if (ini->index.offsets.empty()) {
+        int err = index_ini(ini);
+        if (err) {
+            return err;
+        }
+    } else if ((ini->flags & INI_VALIDATE_UTF8) && ini->utf8_checked < ini->buf.length) {
+        int base = ini->cursor;
+        int line = ini->line;
+        int err = check_utf8(ini, ini->buf.length, &base, &line);
+        if (err) {
+            return err;
+        }
+    }
+
+    const char *data = ini->buf.data;
+    const int length = ini->buf.length;
+    const int *off = ini->index.offsets.data();  // ends with the length sentinel, so never runs off the end
+    size_t i = 0;
+
+    while (ini->cursor < length) {
+        switch (data[ini->cursor]) {
+            case '\r': {
+                if (ini->cursor < length - 1 && data[ini->cursor + 1] == '\n') {
+                    // \r\n, let the \n count the line
+                } else {
+                    ini->line++;
+                }
+                break;
+            }
+            case '\n': {
+                ini->line++;
+                break;
+            }
+            case ' ': case '\t': {
+                break;
+            }
+            case ';': {
+                // comment runs until the next newline
+                while (off[i] <= ini->cursor) i++;
+                while (off[i] < length && data[off[i]] != '\r' && data[off[i]] != '\n') i++;
+                INI_STAT(ini->stats.comment_bytes += off[i] - ini->cursor);
+                ini->cursor = off[i];
+                continue;
+            }
+            case '[': {
+                // section header runs until the next ']'
+                while (off[i] <= ini->cursor) i++;
+                size_t header = i;
+                while (off[i] < length && data[off[i]] != ']') i++;
+                if (off[i] == length) {
+                    int err = report_error(ini, ini->cursor, INI_ERROR_SECTION_EOF, "Expected ']', encountered EOF instead");
+                    if (err == INI_SKIPPED) {
+                        // Carry on from the end of the line, which is back before where the search ended up
+                        i = header;
+                        discard_comment(ini);
+                        continue;
+                    }
+                    return err;
+                }
+                int err = emit_section(ini, slice{ ini->buf.data + ini->cursor + 1, off[i] - ini->cursor - 1 });
+                ini->cursor = off[i];
+                if (err) {
+                    ini->cursor++;
+                    return err;
+                }
+                break;
+            }
+            default: {
+                // key runs until the next '=', which has to come before the next newline
+                int key_begin = ini->cursor;
+                while (off[i] < key_begin) i++;
+                while (off[i] < length && data[off[i]] != '=' && data[off[i]] != '\r' && data[off[i]] != '\n') i++;
+                int key_end = off[i];
+
+                int err = 0;
+                if (key_end == length) {
+                    err = report_error(ini, key_begin, INI_ERROR_KEY_EOF, "Expected '=' after key, encountered EOF instead");
+                } else if (data[key_end] != '=') {
+                    err = report_error(ini, key_end, INI_ERROR_KEY_EOL, "Expected '=', encountered EOL instead");
+                }
+                if (err == INI_SKIPPED) {
+                    ini->cursor = key_end;
+                    continue;
+                }
+                if (err) {
+                    return err;
+                }
+
+                // value runs from the first non-whitespace after '=' until the next newline
+                ini->cursor = key_end + 1;
+                discard_whitespace(ini);
+                int value_begin = ini->cursor;
+                while (off[i] < value_begin) i++;
+                while (off[i] < length && data[off[i]] != '\r' && data[off[i]] != '\n') i++;
+                int value_end = off[i];
+                ini->cursor = value_end;
+
+                err = emit_kv(ini, key_begin, key_end, value_begin, value_end);
+                if (err && err != INI_SKIPPED) {
+                    return err;
+                }
+                continue;
+            }
+        }
+        ini->cursor++;
+    }
+    return ini->errors.size() != errors ? -1 : 0;
+}
+
+// Offset just past the first newline at or after pos, or length if there isn't one. \r\n counts as one newline.
+static int next_line_start(const ini_parser *ini, int pos)
+{
+    const char *data = ini->buf.data;
+    int length = ini->buf.length;
+    int eol = (int)(ini->scan->find_eol(data + pos, data + length) - data);
+    if (eol == length) {
+        return length;
+    }
+    if (data[eol] == '\r' && eol + 1 < length && data[eol + 1] == '\n') {
+        eol++;
+    }
+    return eol + 1;
+}
+
+// Move every value other copied into its string arena over to ini's, they stay valid as long as ini's do
+static void adopt_strings(ini_parser *ini, ini_parser *other)
+{
+    ini_arena_block **tail = &ini->strings.blocks;
+    while (*tail) {
+        tail = &(*tail)->next;
+    }
+    *tail = other->strings.blocks;
+    other->strings.blocks = 0;
+}
+
+// Move a value a parallel worker unescaped into its arena back over its quoted text in buf, where a
+// serial parse of a writable buffer would have unescaped it: right after the '"' that follows the '='
+static void unspill_value(ini_parser *ini, ini_kv *kv)
+{
+    const char *end = ini->buf.data + ini->buf.length;
+    char *p = (char *)memchr(kv->key.data + kv->key.length, '=', end - (kv->key.data + kv->key.length));
+    assert(p);
+    p++;
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    assert(p < end && *p == '"');
+    memcpy(p + 1, kv->value.data, kv->value.length);
+    kv->value.data = p + 1;
+    kv->flags = (kv->flags & ~INI_VALUE_SPILLED) | INI_VALUE_IN_PLACE;
+}
+
+// Parse the rest of the buffer on several threads. The buffer is split into chunks at line boundaries,
+// each chunk is parsed into its own properties, then the chunks are stitched back together in order.
+// Output (properties, errors, final line/section) is exactly what parse_ini() would produce.
+// thread_count: max # of threads to use, 0 = one per hardware thread
+// min_chunk   : don't bother splitting off chunks smaller than this many bytes
+int parse_ini_parallel(ini_parser *ini, int thread_count, int min_chunk)
+{
+    INI_STATS_SCOPE(ini, "parse_ini_parallel");
+    if (thread_count <= 0) {
+        thread_count = (int)std::thread::hardware_concurrency();
+    }
+    if (min_chunk < 1) {
+        min_chunk = 1;
+    }
+
+    int begin = ini->cursor;
+    int remaining = ini->buf.length - begin;
+    int max_chunks = remaining / min_chunk;
+    int chunk_count = thread_count < max_chunks ? thread_count : max_chunks;
+    if (chunk_count < 2) {
+        return parse_ini(ini);
+    }
+
+    // Split at the first line start after each evenly spaced offset, tiny/duplicate chunks are dropped
+    std::vector<int> starts;
+    starts.push_back(begin);
+    for (int i = 1; i < chunk_count; i++) {
+        int start = next_line_start(ini, begin + (int)((long long)remaining * i / chunk_count));
+        if (start > starts.back() && start < ini->buf.length) {
+            starts.push_back(start);
+        }
+    }
+    starts.push_back(ini->buf.length);
+    chunk_count = (int)starts.size() - 1;
+
+    // Each chunk gets its own quiet, heap-backed (arenas aren't thread-safe) parser over just its bytes.
+    // A chunk doesn't know which section it starts in, so its properties keep a nil section until it sees
+    // its own [header]. If the caller wants more than plain properties, the chunks also record their
+    // headers so the merge can replay everything through the normal store path in file order.
+    bool replay = (ini->flags & ~INI_BUILD_LOOKUP) != 0 || visiting(ini);
+    bool validate = (ini->flags & INI_VALIDATE_UTF8) && ini->utf8_checked < ini->buf.length;
+    std::vector<ini_parser> chunks(chunk_count);
+    std::vector<int> results(chunk_count);
+    std::vector<char> valid(chunk_count, 1);
+    auto parse_chunk = [&](int c) {
+        ini_parser *chunk = &chunks[c];
+        buffer chunk_buf{ ini->buf.data + starts[c], starts[c + 1] - starts[c] };
+        init_ini(chunk, chunk_buf);
+        chunk->cursor = 0;          // only the file's first bytes can be a byte order mark, and c == 0 is past it
+        chunk->scan = ini->scan;
+        chunk->quiet = true;
+        // Workers never unescape in place, if a chunk fails the rest of the buffer is parsed again below.
+        // Once a chunk is merged its values can go back into a writable buf, see unspill_value().
+        chunk->flags = (replay ? INI_RECORD_HEADERS : 0) | (ini->flags & INI_QUOTED_VALUES);
+        // Chunks start on a line, so they can validate their own bytes. A serial parse validates everything
+        // before parsing anything though, so they only say whether that would fail.
+        if (validate) {
+            valid[c] = ini->scan->validate_utf8(chunk_buf.data, chunk_buf.data + chunk_buf.length) ==
+                chunk_buf.data + chunk_buf.length;
+        }
+        results[c] = parse_ini(chunk);
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(chunk_count - 1);
+    for (int c = 1; c < chunk_count; c++) {
+        threads.emplace_back(parse_chunk, c);
+    }
+    parse_chunk(0);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    for (auto &chunk : chunks) {
+        adopt_strings(ini, &chunk);
+    }
+    if (validate) {
+        if (std::find(valid.begin(), valid.end(), 0) != valid.end()) {
+            // Let the serial parse report the invalid bytes (or every line with some, with INI_RECOVER)
+            return parse_ini(ini);
+        }
+        ini->utf8_checked = ini->buf.length;
+    }
+
+    // Merge chunks in order, fixing up inherited sections and line numbers as we go
+    if (!replay) {
+        size_t total = ini->properties.size();
+        for (auto &chunk : chunks) {
+            total += chunk.properties.size();
+        }
+        INI_STAT(size_t capacity = ini->properties.capacity());
+        ini->properties.reserve(total);
+        INI_STAT(ini->stats.reallocations += capacity && ini->properties.capacity() != capacity);
+    }
+
+    for (int c = 0; c < chunk_count; c++) {
+        if (results[c] < 0) {
+            // Serial parse would have failed in here (or a header ran past the end of the chunk), so
+            // redo the rest of the buffer serially to get the exact same properties and error
+            ini->cursor = starts[c];
+            return parse_ini(ini);
+        }
+
+        if (replay) {
+            for (ini_kv kv : chunks[c].properties) {
+                int err;
+                int stop_at;
+                if (!kv.key.data) {
+                    err = emit_section(ini, kv.section);
+                    stop_at = (int)(kv.section.data + kv.section.length + 1 - ini->buf.data);
+                } else {
+                    kv.section = ini->section;
+                    // Same place parse_kv() leaves the cursor, the value itself might not even be in buf
+                    stop_at = (int)(ini->scan->find_eol(kv.key.data, ini->buf.data + ini->buf.length) - ini->buf.data);
+                    if (ini->writable && (kv.flags & INI_VALUE_SPILLED)) {
+                        unspill_value(ini, &kv);
+                    }
+                    err = store_kv(ini, kv);
+                }
+                if (err) {
+                    // Visitor stopped us, line isn't tracked per statement so it's left at the chunk start
+                    ini->cursor = stop_at;
+                    return err;
+                }
+            }
+        } else {
+            for (ini_kv kv : chunks[c].properties) {
+                if (!kv.section.data) {
+                    kv.section = ini->section;
+                }
+                ini->properties.push_back(kv);
+            }
+            if (chunks[c].section.data) {
+                ini->section = chunks[c].section;
+            }
+            INI_STAT(ini->stats.properties += (int)chunks[c].properties.size());
+            INI_STAT(ini->stats.sections += chunks[c].stats.sections);
+        }
+        INI_STAT(ini->stats.comment_bytes += chunks[c].stats.comment_bytes);
+        ini->line += chunks[c].line - 1;
+    }
+
+    if (!replay && (ini->flags & INI_BUILD_LOOKUP)) {
+        update_ini_lookup(ini);
+    }
+
+    ini->cursor = ini->buf.length;
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Schema
+//------------------------------------------------------------------------------
+
+// Everything a schema parse's visitor needs, see ini_parse_schema()
+struct schema_state {
+    ini_parser *ini;
+    const ini_field *fields;
+    const int *section_lengths;
+    const int *key_lengths;
+    const uint32_t *displacements;
+    const int *slots;
+    size_t bucket_mask;
+    size_t mask;
+    char *out;
+    int err;
+    void (*error)(void *user, int line, const char *msg);  // caller's visitor error callback
+    void *error_user;
+};
+
+static int schema_visit_kv(void *user, const ini_kv *kv)
+{
+    schema_state *state = (schema_state *)user;
+    uint32_t hash = ini_schema_hash(kv->section.data, kv->section.length, kv->key.data, kv->key.length);
+    uint32_t d = state->displacements[hash & state->bucket_mask];
+    int index = state->slots[ini_schema_slot(hash, d) & state->mask];
+    if (index < 0) {
+        return 0;
+    }
+    const ini_field &field = state->fields[index];
+    if (state->section_lengths[index] != kv->section.length || state->key_lengths[index] != kv->key.length ||
+        (kv->section.length && memcmp(field.section, kv->section.data, kv->section.length)) ||
+        memcmp(field.key, kv->key.data, kv->key.length)) {
+        return 0;
+    }
+
+    char *member = state->out + field.offset;
+    int err = 0;
+    switch (field.type) {
+        case INI_TYPE_INT: {
+            int64_t i = 0;
+            err = ini_parse_int(kv->value, &i);
+            if (!err && field.size == 4) {
+                if (i < INT_MIN || i > INT_MAX) {
+                    err = -1;
+                } else {
+                    int32_t i32 = (int32_t)i;
+                    memcpy(member, &i32, sizeof(i32));
+                }
+            } else if (!err) {
+                memcpy(member, &i, sizeof(i));
+            }
+            break;
+        }
+        case INI_TYPE_DOUBLE: {
+            double d = 0;
+            err = ini_parse_double(kv->value, &d);
+            if (!err && field.size == 4) {
+                float f = (float)d;
+                memcpy(member, &f, sizeof(f));
+            } else if (!err) {
+                memcpy(member, &d, sizeof(d));
+            }
+            break;
+        }
+        case INI_TYPE_BOOL: {
+            bool b = false;
+            err = ini_parse_bool(kv->value, &b);
+            if (!err) {
+                memcpy(member, &b, sizeof(b));
+            }
+            break;
+        }
+        case INI_TYPE_DURATION: {
+            int64_t ns = 0;
+            err = ini_parse_duration(kv->value, &ns);
+            if (!err) {
+                memcpy(member, &ns, sizeof(ns));
+            }
+            break;
+        }
+        case INI_TYPE_SIZE: {
+            uint64_t bytes = 0;
+            err = ini_parse_size(kv->value, &bytes);
+            if (!err) {
+                memcpy(member, &bytes, sizeof(bytes));
+            }
+            break;
+        }
+        case INI_TYPE_STRING: {
+            memcpy(member, &kv->value, sizeof(slice));
+            break;
+        }
+    }
+    if (err) {
+        ini_parser *ini = state->ini;
+        state->err = -1;
+        // With INI_RECOVER keep going so every bad field gets reported
+        return report_error(ini, (int)(kv->key.data - ini->buf.data), INI_ERROR_TYPE,
+            "Value doesn't match the type of its schema field") != INI_SKIPPED;
+    }
+    return 0;
+}
+
+static void schema_visit_error(void *user, int line, const char *msg)
+{
+    schema_state *state = (schema_state *)user;
+    state->error(state->error_user, line, msg);
+}
+
+// Untyped part of ini_parse_schema(), see there
+int ini_parse_fields(ini_parser *ini, const ini_field *fields, const int *section_lengths, const int *key_lengths,
+    const uint32_t *displacements, size_t bucket_count, const int *slots, size_t slot_count, void *out)
+{
+    assert(ini);
+    assert(out);
+
+    schema_state state{};
+    state.ini = ini;
+    state.fields = fields;
+    state.section_lengths = section_lengths;
+    state.key_lengths = key_lengths;
+    state.displacements = displacements;
+    state.slots = slots;
+    state.bucket_mask = bucket_count - 1;
+    state.mask = slot_count - 1;
+    state.out = (char *)out;
+
+    // Errors still go to the caller's error callback (with their user pointer), if they had one
+    ini_visitor visitor = ini->visitor;
+    state.error = visitor.error;
+    state.error_user = visitor.user;
+    ini->visitor = ini_visitor{};
+    ini->visitor.kv = schema_visit_kv;
+    ini->visitor.error = visitor.error ? schema_visit_error : 0;
+    ini->visitor.user = &state;
+
+    int err = parse_ini(ini);
+    ini->visitor = visitor;
+    return state.err ? state.err : err;
+}
+
+//------------------------------------------------------------------------------
+// Lazy sections
+//------------------------------------------------------------------------------
+
+// Returns index of the first header called name in ini->lazy.sections, or -1 if there isn't one
+static int lazy_find(const ini_parser *ini, slice name)
+{
+    const ini_table *table = &ini->lazy.table;
+    if (!name.length) {
+        return ini->lazy.sections.empty() ? -1 : 0;
+    }
+    if (!table->count) {
+        return -1;
+    }
+    uint32_t hash = hash_slice(name);
+    size_t mask = table->slots.size() - 1;
+    size_t i = hash & mask;
+    while (table->slots[i].index >= 0) {
+        const ini_slot &slot = table->slots[i];
+        if (slot.hash == hash && slice_equal(ini->lazy.sections[slot.index].name, name)) {
+            return slot.index;
+        }
+        i = (i + 1) & mask;
+    }
+    return -1;
+}
+
+// Record a header whose body starts at body_begin, chaining it to any earlier header with the same name
+static void lazy_add(ini_parser *ini, slice name, int body_begin)
+{
+    ini_lazy *lazy = &ini->lazy;
+    int index = (int)lazy->sections.size();
+    if (index) {
+        lazy->sections[index - 1].body_end = name.data - 1 - ini->buf.data;
+    }
+    lazy->sections.push_back(ini_lazy_section{ name, body_begin, ini->buf.length, ini->line, -1, false });
+    if (!name.length) {
+        if (index) {
+            // "[]" is the unnamed section too, index 0 heads its chain
+            int last = 0;
+            while (lazy->sections[last].next >= 0) last = lazy->sections[last].next;
+            lazy->sections[last].next = index;
+        }
+        return;
+    }
+
+    int first = lazy_find(ini, name);
+    if (first >= 0) {
+        // Same section opened again further down, rare enough that walking the chain is fine
+        int last = first;
+        while (lazy->sections[last].next >= 0) last = lazy->sections[last].next;
+        lazy->sections[last].next = index;
+        return;
+    }
+
+    ini_table *table = &lazy->table;
+    table_grow(table);
+    uint32_t hash = hash_slice(name);
+    size_t mask = table->slots.size() - 1;
+    size_t i = hash & mask;
+    while (table->slots[i].index >= 0) {
+        i = (i + 1) & mask;
+    }
+    table->slots[i] = ini_slot{ hash, index };
+    table->count++;
+}
+
+// First pass of the lazy parse: only find the [section] headers in the rest of the buffer and record where
+// each one's body is, without parsing any properties. Bodies are parsed by ini_load_section() (or
+// ini_lazy_get()) the first time they're needed, so a caller that only touches a few sections of a big file
+// only pays for those. Headers are found exactly where parse_ini() would find them.
+// Errors in a body (e.g. a line without '=') are only reported once that body gets loaded.
+// Returns 0 on success, -1 if a header is missing its ']', with INI_RECOVER only once every such line has been skipped
+int index_ini_sections(ini_parser *ini)
+{
+    INI_TRACE_SCOPE("index_ini_sections");
+    const char *data = ini->buf.data;
+    const char *end = data + ini->buf.length;
+    ini_lazy *lazy = &ini->lazy;
+    lazy->sections.clear();
+    lazy->table.slots.clear();
+    lazy->table.count = 0;
+    size_t errors = ini->errors.size();
+    if ((ini->flags & INI_VALIDATE_UTF8) && ini->utf8_checked < ini->buf.length) {
+        int base = ini->cursor;
+        int line = ini->line;
+        int err = check_utf8(ini, ini->buf.length, &base, &line);
+        if (err) {
+            return err;
+        }
+    }
+
+    // Properties before the first header, it's always there even if it's empty
+    lazy_add(ini, slice{}, ini->cursor);
+
+    while (ini->cursor < ini->buf.length) {
+        switch (data[ini->cursor]) {
+            case '\r': {
+                if (ini->cursor < ini->buf.length - 1 && data[ini->cursor + 1] == '\n') {
+                    // \r\n, let the \n count the line
+                } else {
+                    ini->line++;
+                }
+                break;
+            }
+            case '\n': {
+                ini->line++;
+                break;
+            }
+            case ' ': case '\t': {
+                break;
+            }
+            case '[': {
+                int name_begin = ini->cursor + 1;
+                int name_end = (int)(ini->scan->find_char(data + name_begin, end, ']') - data);
+                if (name_end == ini->buf.length) {
+                    int err = report_error(ini, ini->cursor, INI_ERROR_SECTION_EOF, "Expected ']', encountered EOF instead");
+                    if (err == INI_SKIPPED) {
+                        ini->cursor = (int)(ini->scan->find_eol(data + ini->cursor, end) - data);
+                        continue;
+                    }
+                    return err;
+                }
+                lazy_add(ini, slice{ ini->buf.data + name_begin, name_end - name_begin }, name_end + 1);
+                ini->cursor = name_end;
+                break;
+            }
+            default: {
+                // Comments and properties both run until the newline, skip them without looking inside
+                ini->cursor = (int)(ini->scan->find_eol(data + ini->cursor, end) - data);
+                continue;
+            }
+        }
+        ini->cursor++;
+    }
+    return ini->errors.size() != errors ? -1 : 0;
+}
+
+// Parse the body of every header called name that hasn't been parsed yet, in file order. Its properties are
+// stored like parse_ini() would store them (lookup table, layouts and visitor all apply), appended after
+// whatever has been loaded before. Everything else about the parser (cursor, line, section) is left alone.
+// Returns 0 on success (including if there is no such section), or the first error from parse_ini()
+int ini_load_section(ini_parser *ini, slice name)
+{
+    INI_TRACE_SCOPE("ini_load_section");
+    buffer buf = ini->buf;
+    int cursor = ini->cursor;
+    int line = ini->line;
+    slice section = ini->section;
+    uint32_t section_index = ini->section_index;
+
+    int err = 0;
+    for (int s = lazy_find(ini, name); s >= 0 && !err; s = ini->lazy.sections[s].next) {
+        ini_lazy_section &lazy = ini->lazy.sections[s];
+        if (lazy.loaded) {
+            continue;
+        }
+        lazy.loaded = true;
+
+        // Parse just the body, as if the header had just been read
+        ini->buf.length = lazy.body_end;
+        ini->cursor = lazy.body_begin;
+        ini->line = lazy.line;
+        if (s) {
+            err = emit_section(ini, lazy.name);
+        } else {
+            ini->section = slice{};
+            ini->section_index = 0;
+        }
+        if (!err) {
+            err = parse_ini(ini);
+        }
+    }
+
+    ini->buf = buf;
+    ini->cursor = cursor;
+    ini->line = line;
+    ini->section = section;
+    ini->section_index = section_index;
+    return err;
+}
+
+// ini_get() for a parser set up by index_ini_sections(), loads the section first if it hasn't been yet
+// Returns value of [section] key, or an empty slice (data == 0) if there is no such property
+slice ini_lazy_get(ini_parser *ini, slice section, slice key)
+{
+    ini_load_section(ini, section);
+    return ini_get(ini, section, key);
+}
+
+slice ini_lazy_get(ini_parser *ini, const char *section, const char *key)
+{
+    assert(section);
+    assert(key);
+    slice s{ (char *)section, (int)strlen(section) };
+    slice k{ (char *)key, (int)strlen(key) };
+    return ini_lazy_get(ini, s, k);
+}
+
+//------------------------------------------------------------------------------
+// Reload
+//------------------------------------------------------------------------------
+
+// Length of the common prefix of a and b (both length bytes long)
+static size_t common_prefix(const char *a, const char *b, size_t length)
+{
+    size_t i = 0;
+    while (i + 64 <= length && !memcmp(a + i, b + i, 64)) {
+        i += 64;
+    }
+    while (i < length && a[i] == b[i]) {
+        i++;
+    }
+    return i;
+}
+
+// Length of the common suffix of a and b (both end at a_end/b_end), at most length bytes
+static size_t common_suffix(const char *a_end, const char *b_end, size_t length)
+{
+    size_t i = 0;
+    while (i + 64 <= length && !memcmp(a_end - i - 64, b_end - i - 64, 64)) {
+        i += 64;
+    }
+    while (i < length && a_end[-(ptrdiff_t)i - 1] == b_end[-(ptrdiff_t)i - 1]) {
+        i++;
+    }
+    return i;
+}
+
+// Index of the first property in ini->properties whose key starts at or after p (properties are in file order)
+static int first_property_at(const ini_parser *ini, const char *p)
+{
+    int lo = 0;
+    int hi = (int)ini->properties.size();
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (ini->properties[mid].key.data < p) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// State for the visitor that re-parses the changed part of the new buffer
+struct reload_state {
+    ini_parser *parser;             // parser doing the re-parse
+    ini_parser *old;
+    ptrdiff_t delta;                // new length - old length
+    int suffix_begin;               // bytes from here on (in the new buffer) are the same as in the old one
+    std::vector<ini_kv> properties; // re-parsed properties, up to (not including) the resync point
+    int resync;                     // index of the old property the rest of the new parse is identical to, or -1
+    int resync_line;                // re-parse's line # at the resync point
+    slice resync_section;           // new buffer's current section at the resync point
+};
+
+static int reload_visit_kv(void *user, const ini_kv *kv)
+{
+    reload_state *state = (reload_state *)user;
+    int offset = (int)(kv->key.data - state->parser->buf.data);
+    if (offset >= state->suffix_begin) {
+        // Everything from here on reads exactly what the old parse read, so if it started a property right
+        // here in the same section, the rest of the old properties can be reused as they are
+        const char *old_key = state->old->buf.data + (offset - state->delta);
+        int j = first_property_at(state->old, old_key);
+        if (j < (int)state->old->properties.size() && state->old->properties[j].key.data == old_key &&
+            slice_equal(state->old->properties[j].section, kv->section) &&
+            !state->old->properties[j].section.data == !kv->section.data) {
+            state->resync = j;
+            state->resync_line = state->parser->line;
+            state->resync_section = kv->section;
+            return 1;
+        }
+    }
+    state->properties.push_back(*kv);
+    return 0;
+}
+
+// Store a property in a parser being rebuilt by reload_ini(), entering its section first if it's a new one
+static void reload_store(ini_parser *ini, const ini_kv &kv)
+{
+    if (kv.section.data != ini->section.data || kv.section.length != ini->section.length) {
+        if (kv.section.data) {
+            emit_section(ini, kv.section);
+        } else {
+            ini->section = slice{};
+            ini->section_index = 0;
+        }
+    }
+    store_kv(ini, ini_kv{ ini->section, kv.key, kv.value, kv.flags });
+}
+
+// Add a change for section+key to changes if its effective value differs between old and ini
+static void reload_diff(ini_parser *old, int old_kv, ini_parser *ini, int new_kv, std::vector<ini_change> *changes)
+{
+    if (old_kv < 0 && new_kv < 0) {
+        return;
+    }
+    ini_change change{};
+    if (old_kv < 0) {
+        const ini_kv &kv = ini->properties[new_kv];
+        change = ini_change{ INI_ADDED, kv.section, kv.key, slice{}, kv.value };
+    } else if (new_kv < 0) {
+        const ini_kv &kv = old->properties[old_kv];
+        change = ini_change{ INI_REMOVED, kv.section, kv.key, kv.value, slice{} };
+    } else {
+        const ini_kv &was = old->properties[old_kv];
+        const ini_kv &kv = ini->properties[new_kv];
+        if (slice_equal(was.value, kv.value)) {
+            return;
+        }
+        change = ini_change{ INI_MODIFIED, kv.section, kv.key, was.value, kv.value };
+    }
+    changes->push_back(change);
+}
+
+// Parse buf, the new contents of the file old was parsed from, re-parsing only the part that changed.
+// The common prefix and suffix of the two buffers are found first. Parsing restarts at the last property
+// before the first changed byte and stops as soon as it's back in step with the old parse, the old
+// properties before and after that are rebased onto buf instead of being parsed again. ini ends up with
+// exactly the properties, line and section parse_ini() would produce, with the same flags as old (its
+// lookup table and layouts are rebuilt from the properties, [section]s without properties aren't interned).
+// With INI_QUOTED_VALUES all of buf is parsed, buf has to be as writable as old's was. So is it if old's
+// parse ran into errors (INI_RECOVER), their lines may not have changed but they have to be reported again.
+// old    : finished parse with properties (not INI_NO_PROPERTIES or a visitor), its buffer must still be
+//          valid. Its lookup table is built if it didn't have one.
+// ini    : gets the new parse, must not be old
+// changes: effective properties (what ini_get() returns) that were added, removed or modified, old_value
+//          points into the old buffer
+// arena  : backs ini's tables, see init_ini()
+// Returns 0 on success, or the error parse_ini() would return for buf (with ini left as parse_ini() leaves it)
+int reload_ini(ini_parser *old, buffer buf, ini_parser *ini, std::vector<ini_change> *changes, ini_arena *arena)
+{
+    assert(old);
+    assert(ini);
+    assert(ini != old);
+    assert(changes);
+    assert(!(old->flags & INI_NO_PROPERTIES) && !visiting(old));
+
+    changes->clear();
+    init_ini(ini, buffer{}, arena);
+    ini->buf = buf;
+    ini->cursor = utf8_bom_length(buf);
+    ini->scan = old->scan;
+    ini->quiet = old->quiet;
+    ini->flags = old->flags;
+    ini->visitor = ini_visitor{};
+    ini->visitor.error = old->visitor.error;
+    ini->visitor.user = old->visitor.user;
+    ini->writable = old->writable;
+    INI_STATS_SCOPE(ini, "reload_ini");
+
+    if ((old->flags & (INI_QUOTED_VALUES | INI_VALIDATE_UTF8)) || old->error.code) {
+        // Values may have been unescaped over old's bytes or copied out of them, so neither the bytes nor
+        // the slices can be reused. Parse all of buf and compare every effective property instead. The
+        // same goes for validation, which has to look at all of buf anyway, and for a parse with errors
+        // (the re-parse only reports those in the part that changed).
+        ini->estimated_properties = estimate_ini_properties(ini);
+        int err = parse_ini(ini);
+        if (err < 0) {
+            return err;
+        }
+        for (int i = 0; i < (int)ini->properties.size(); i++) {
+            const ini_kv &kv = ini->properties[i];
+            if (ini_find(ini, kv.section, kv.key) == i) {
+                reload_diff(old, ini_find(old, kv.section, kv.key), ini, i, changes);
+            }
+        }
+        for (int i = 0; i < (int)old->properties.size(); i++) {
+            const ini_kv &kv = old->properties[i];
+            if (ini_find(old, kv.section, kv.key) == i && ini_find(ini, kv.section, kv.key) < 0) {
+                reload_diff(old, i, ini, -1, changes);
+            }
+        }
+        return 0;
+    }
+
+    const char *old_data = old->buf.data;
+    int old_length = old->buf.length;
+    int shorter = old_length < buf.length ? old_length : buf.length;
+    int prefix = (int)common_prefix(old_data, buf.data, (size_t)shorter);
+    int suffix = (int)common_suffix(old_data + old_length, buf.data + buf.length, (size_t)(shorter - prefix));
+    ptrdiff_t delta = buf.length - old_length;
+
+    // Restart at the last property starting before the first change, anything before it can't be affected.
+    // Without one, start over from the beginning. If the old parse didn't finish we don't know what the
+    // rest of it looked like, so parse it all.
+    bool finished = old->cursor >= old_length;
+    int first = finished ? first_property_at(old, old_data + prefix) - 1 : -1;
+    bool resume = first >= 0;
+    if (!resume) {
+        first = 0;
+    }
+    auto rebase = [&](slice s, ptrdiff_t shift) {
+        return s.data ? slice{ buf.data + (s.data - old_data) + shift, s.length } : s;
+    };
+
+    ini_parser parser{};
+    init_ini(&parser, buffer{}, arena);
+    parser.buf = buf;
+    parser.cursor = ini->cursor;
+    parser.scan = old->scan;
+    parser.quiet = true;
+    reload_state state{};
+    state.parser = &parser;
+    state.old = old;
+    state.delta = delta;
+    state.suffix_begin = finished ? buf.length - suffix : INT_MAX;
+    state.resync = -1;
+    if (resume) {
+        parser.cursor = (int)(old->properties[first].key.data - old_data);
+        parser.section = rebase(old->properties[first].section, 0);
+    }
+    int restart = parser.cursor;
+    parser.visitor.kv = reload_visit_kv;
+    parser.visitor.user = &state;
+
+    int err = parse_ini(&parser);
+    if (err < 0) {
+        // Let a full parse report the error, with the right line number
+        ini->buf = buf;
+        ini->estimated_properties = estimate_ini_properties(ini);
+        return parse_ini(ini);
+    }
+
+    // Rebuild: unchanged prefix, re-parsed middle, unchanged (shifted) suffix
+    int resync = state.resync >= 0 ? state.resync : (int)old->properties.size();
+    ini->estimated_properties = first + (int)state.properties.size() + ((int)old->properties.size() - resync);
+    for (int i = 0; i < first; i++) {
+        const ini_kv &kv = old->properties[i];
+        reload_store(ini, ini_kv{ rebase(kv.section, 0), rebase(kv.key, 0), rebase(kv.value, 0), kv.flags });
+    }
+    for (const ini_kv &kv : state.properties) {
+        reload_store(ini, kv);
+    }
+
+    if (state.resync >= 0) {
+        const char *resync_at = old->properties[resync].key.data;
+        for (int i = resync; i < (int)old->properties.size(); i++) {
+            const ini_kv &kv = old->properties[i];
+            // Properties before the next header carry on in the section the re-parse was in
+            slice section = kv.section.data >= resync_at ? rebase(kv.section, delta) : state.resync_section;
+            reload_store(ini, ini_kv{ section, rebase(kv.key, delta), rebase(kv.value, delta), kv.flags });
+        }
+        int old_lines = count_lines(old_data + restart, resync_at);
+        ini->line = old->line - old_lines + (state.resync_line - 1);
+        ini->section = old->section.data >= resync_at ? rebase(old->section, delta) : state.resync_section;
+    } else {
+        int restart_line = resume ? old->line - count_lines(old_data + restart, old_data + old_length) : 1;
+        ini->line = restart_line + parser.line - 1;
+        ini->section = parser.section;
+    }
+    ini->cursor = buf.length;
+
+    // Only properties in the replaced range can have changed what ini_get() returns: if the property that
+    // wins either before or after lies outside it, the same bytes win in both
+    int old_end = resync;
+    int new_begin = first;
+    int new_end = first + (int)state.properties.size();
+    for (int i = new_begin; i < new_end; i++) {
+        const ini_kv &kv = ini->properties[i];
+        if (ini_find(ini, kv.section, kv.key) == i) {
+            reload_diff(old, ini_find(old, kv.section, kv.key), ini, i, changes);
+        }
+    }
+    for (int i = first; i < old_end; i++) {
+        const ini_kv &kv = old->properties[i];
+        if (ini_find(old, kv.section, kv.key) == i) {
+            int now = ini_find(ini, kv.section, kv.key);
+            if (now < new_begin || now >= new_end) {
+                reload_diff(old, i, ini, now, changes);
+            }
+        }
+    }
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Overlay
+//------------------------------------------------------------------------------
+
+// Index of section+key's entry in overlay, or -1 if it doesn't have one. Entries of keys no layer has any
+// more don't match anything (their strings may be gone), they're skipped and reused instead.
+// free: if given, gets the slot the key can be inserted at: the first dead entry's, or else an empty one
+static int overlay_probe(const ini_overlay *overlay, uint32_t hash, slice section, slice key, size_t *free)
+{
+    const ini_table *table = &overlay->table;
+    if (table->slots.empty()) {
+        return -1;
+    }
+    size_t mask = table->slots.size() - 1;
+    size_t i = hash & mask;
+    size_t dead = SIZE_MAX;
+    while (table->slots[i].index >= 0) {
+        const ini_slot &slot = table->slots[i];
+        const ini_overlay_kv &entry = overlay->entries[slot.index];
+        if (entry.layer < 0) {
+            dead = dead == SIZE_MAX ? i : dead;
+        } else if (slot.hash == hash && slice_equal(entry.section, section) && slice_equal(entry.key, key)) {
+            return slot.index;
+        }
+        i = (i + 1) & mask;
+    }
+    if (free) {
+        *free = dead != SIZE_MAX ? dead : i;
+    }
+    return -1;
+}
+
+// Point section+key's entry at layers[layer]->properties[kv] unless a higher layer has it, adding the
+// entry if the overlay doesn't have one yet
+static void overlay_put(ini_overlay *overlay, int layer, int kv)
+{
+    const ini_kv &prop = overlay->layers[layer]->properties[kv];
+    uint32_t hash = hash_section_key(prop.section, prop.key);
+    table_grow(&overlay->table);
+    size_t free = 0;
+    int found = overlay_probe(overlay, hash, prop.section, prop.key, &free);
+    if (found < 0) {
+        ini_slot &slot = overlay->table.slots[free];
+        if (slot.index >= 0) {
+            found = slot.index;
+        } else {
+            found = (int)overlay->entries.size();
+            overlay->entries.push_back(ini_overlay_kv{});
+            overlay->table.count++;
+        }
+        slot = ini_slot{ hash, found };
+        overlay->entries[found].layer = -1;
+    }
+    ini_overlay_kv &entry = overlay->entries[found];
+    if (entry.layer <= layer) {
+        entry = ini_overlay_kv{ prop.section, prop.key, prop.value, layer, kv };
+    }
+}
+
+// Merge count parsed layers, lowest priority first
+// layers: finished parses with properties (not INI_NO_PROPERTIES, INI_LAYOUT_COMPACT or a visitor)
+void init_ini_overlay(ini_overlay *overlay, ini_parser **layers, int count)
+{
+    assert(overlay);
+    assert(layers || !count);
+
+    *overlay = ini_overlay{};
+    overlay->layers.assign(layers, layers + count);
+    for (int layer = 0; layer < count; layer++) {
+        ini_parser *ini = layers[layer];
+        assert(!(ini->flags & (INI_NO_PROPERTIES | INI_LAYOUT_COMPACT)) && !visiting(ini));
+        for (int kv = 0; kv < (int)ini->properties.size(); kv++) {
+            overlay_put(overlay, layer, kv);
+        }
+    }
+}
+
+// Release the merged table, the layers are left alone
+void free_ini_overlay(ini_overlay *overlay)
+{
+    assert(overlay);
+    *overlay = ini_overlay{};
+}
+
+// Effective [section] key across all layers in O(1), along with the layer it comes from
+// Returns nil if no layer has it
+const ini_overlay_kv *ini_overlay_find(const ini_overlay *overlay, slice section, slice key)
+{
+    assert(overlay);
+
+    int found = overlay_probe(overlay, hash_section_key(section, key), section, key, 0);
+    if (found < 0) {
+        return 0;
+    }
+    return &overlay->entries[found];
+}
+
+// Returns value of [section] key in the topmost layer that has it, or an empty slice (data == 0) if none does
+slice ini_overlay_get(const ini_overlay *overlay, slice section, slice key)
+{
+    const ini_overlay_kv *entry = ini_overlay_find(overlay, section, key);
+    return entry ? entry->value : slice{};
+}
+
+slice ini_overlay_get(const ini_overlay *overlay, const char *section, const char *key)
+{
+    assert(section);
+    assert(key);
+    return ini_overlay_get(overlay, slice{ (char *)section, (int)strlen(section) }, slice{ (char *)key, (int)strlen(key) });
+}
+
+// Replace layers[layer] with ini, a reload of it, touching only what the layer owns: its entries get
+// pointed at ini's properties, and keys it no longer has fall through to the next layer down that has them.
+// Nothing from the other layers is looked at except for those removed keys.
+// ini    : new parse of the layer, e.g. from reload_ini(layers[layer], ..., ini, changes)
+// changes: properties of the old layer's parse that changed, only the INI_REMOVED ones are used. The old
+//          parse has to stay valid until this returns, the entries still point into it until then.
+void ini_overlay_reload(ini_overlay *overlay, int layer, ini_parser *ini, const std::vector<ini_change> *changes)
+{
+    assert(overlay);
+    assert(layer >= 0 && layer < (int)overlay->layers.size());
+    assert(ini);
+    assert(changes);
+    assert(!(ini->flags & (INI_NO_PROPERTIES | INI_LAYOUT_COMPACT)) && !visiting(ini));
+
+    for (const ini_change &change : *changes) {
+        if (change.kind != INI_REMOVED) {
+            continue;
+        }
+        int found = overlay_probe(overlay, hash_section_key(change.section, change.key), change.section, change.key, 0);
+        if (found < 0 || overlay->entries[found].layer != layer) {
+            continue;
+        }
+        ini_overlay_kv &entry = overlay->entries[found];
+        entry.layer = -1;
+        for (int below = layer - 1; below >= 0; below--) {
+            ini_parser *lower = overlay->layers[below];
+            int kv = ini_find(lower, change.section, change.key);
+            if (kv >= 0) {
+                const ini_kv &prop = lower->properties[kv];
+                entry = ini_overlay_kv{ prop.section, prop.key, prop.value, below, kv };
+                break;
+            }
+        }
+        if (entry.layer < 0) {
+            // Dead, the slot gets reused by the next key inserted past it
+            entry = ini_overlay_kv{ slice{}, slice{}, slice{}, -1, -1 };
+        }
+    }
+
+    // Everything the layer has now, which repoints unchanged keys and takes over added ones
+    overlay->layers[layer] = ini;
+    for (int kv = 0; kv < (int)ini->properties.size(); kv++) {
+        overlay_put(overlay, layer, kv);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Streaming
+//------------------------------------------------------------------------------
+
+// arena: if given, properties and the parser's side tables are allocated from it (see init_ini())
+void init_ini_stream(ini_stream *stream, ini_arena *arena)
+{
+    init_ini(&stream->ini, buffer{}, arena);
+    stream->ini.partial = true;
+    stream->pending = ini_vector<char>();
+    init_arena(&stream->strings);
+    stream->section_src = slice{};
+    stream->section_copy = slice{};
+    stream->started = false;
+    stream->column = 0;
+}
+
+// WARN: properties kept by the stream point into its string arena and are invalid afterwards!!
+void free_ini_stream(ini_stream *stream)
+{
+    free_arena(&stream->strings);
+    free_arena(&stream->ini.strings);
+    stream->pending = ini_vector<char>();
+}
+
+// Returns s itself if it's outside of [begin, end), otherwise a copy of it in the stream's string arena
+static slice stream_keep(ini_stream *stream, slice s, const char *begin, const char *end)
+{
+    if (s.data < begin || s.data >= end) {
+        return s;
+    }
+    char *copy = (char *)arena_alloc(&stream->strings, s.length ? s.length : 1, 1);
+    if (!copy) {
+        throw std::bad_alloc();
+    }
+    memcpy(copy, s.data, s.length);
+    return slice{ copy, s.length };
+}
+
+static slice stream_keep_section(ini_stream *stream, slice s, const char *begin, const char *end)
+{
+    if (s.data < begin || s.data >= end) {
+        return s;
+    }
+    if (s.data != stream->section_src.data || s.length != stream->section_src.length) {
+        stream->section_src = s;
+        stream->section_copy = stream_keep(stream, s, begin, end);
+    }
+    return stream->section_copy;
+}
+
+static int stream_visit_kv(void *user, const ini_kv *kv)
+{
+    ini_stream *stream = (ini_stream *)user;
+    stream->on_kv(stream->user, kv);
+    return 0;
+}
+
+// Parse as much of [data, data + length) as possible, then make sure nothing the stream holds on to still
+// points into it. Returns # of bytes consumed, or a negative error code.
+static int stream_parse(ini_stream *stream, char *data, int length)
+{
+    ini_parser *ini = &stream->ini;
+    const char *end = data + length;
+
+    // The pending buffer gets reused, so a pointer into it from last time could alias different bytes now
+    stream->section_src = slice{};
+
+    // on_kv gets properties straight from the parser, nothing gets stored
+    if (stream->on_kv && !ini->visitor.kv) {
+        ini->visitor.kv = stream_visit_kv;
+        ini->visitor.user = stream;
+    }
+    // Nothing outlives a visitor callback, so values unescaped last time can go
+    if (visiting(ini)) {
+        reset_arena(&ini->strings);
+    }
+
+    size_t first_kv = ini->properties.size();
+    size_t first_section_kv = ini->section_properties.size();
+    size_t first_section = ini->sections.size();
+    size_t first_error = ini->errors.size();
+    bool had_error = ini->error.code != 0;
+
+    ini->buf = buffer{ data, length };
+    ini->cursor = 0;
+    // Every property uses its own line, so this is as effective as the whole-buffer estimate
+    ini->estimated_properties = estimate_ini_properties(ini);
+    // Only what gets consumed is validated below, the rest comes around again with the next piece
+    int line = ini->line;
+    ini->utf8_checked = length;
+    // Properties parsed before an error are kept too, same as parse_ini(), so settle them either way
+    int err = parse_ini(ini);
+    int consumed = ini->cursor;
+    if ((ini->flags & INI_VALIDATE_UTF8) && err >= 0) {
+        int base = 0;
+        ini->utf8_checked = 0;
+        err = check_utf8(ini, consumed, &base, &line);
+    }
+
+    if (!visiting(ini)) {
+        bool both = !(ini->flags & INI_NO_PROPERTIES) && (ini->flags & INI_LAYOUT_SECTIONS);
+        for (size_t i = first_kv; i < ini->properties.size(); i++) {
+            ini_kv &kv = ini->properties[i];
+            kv.section = stream_keep_section(stream, kv.section, data, end);
+            kv.key = stream_keep(stream, kv.key, data, end);
+            kv.value = stream_keep(stream, kv.value, data, end);
+            if (both) {
+                ini_section_kv &skv = ini->section_properties[first_section_kv + (i - first_kv)];
+                skv.key = kv.key;
+                skv.value = kv.value;
+            }
+        }
+        if (!both) {
+            for (size_t i = first_section_kv; i < ini->section_properties.size(); i++) {
+                ini_section_kv &skv = ini->section_properties[i];
+                skv.key = stream_keep(stream, skv.key, data, end);
+                skv.value = stream_keep(stream, skv.value, data, end);
+            }
+        }
+    }
+
+    for (size_t i = first_section; i < ini->sections.size(); i++) {
+        ini->sections[i].name = stream_keep_section(stream, ini->sections[i].name, data, end);
+    }
+    ini->section = stream_keep_section(stream, ini->section, data, end);
+    // Errors on a line that started in an earlier piece count its bytes in there too
+    for (size_t i = first_error; i < ini->errors.size(); i++) {
+        ini_error &error = ini->errors[i];
+        error.text = stream_keep(stream, error.text, data, end);
+        error.column += error.column == error.offset + 1 ? stream->column : 0;
+    }
+    if (!had_error && ini->error.code) {
+        ini->error.text = stream_keep(stream, ini->error.text, data, end);
+        ini->error.column += ini->error.column == ini->error.offset + 1 ? stream->column : 0;
+    }
+    ini->buf = buffer{};
+
+    // INI_RECOVER skipped the bad lines, keep feeding and let ini_finish() report them
+    if (err < 0 && (ini->flags & INI_RECOVER)) {
+        err = 0;
+    }
+    if (err < 0) {
+        return err;
+    }
+    int line_begin = consumed;
+    while (line_begin > 0 && data[line_begin - 1] != '\n' && data[line_begin - 1] != '\r') {
+        line_begin--;
+    }
+    stream->column = line_begin ? consumed - line_begin : stream->column + consumed;
+    return consumed;
+}
+
+// Parse the next piece of input, any length (including 0) is fine
+// Returns 0 on success, negative error code on failure (see stream->ini.error for more info). With INI_RECOVER
+// lines with errors are skipped and only ini_finish() fails.
+int ini_feed(ini_stream *stream, const char *bytes, int length)
+{
+    assert(!(stream->ini.flags & INI_LAYOUT_COMPACT));
+    ini_parser *ini = &stream->ini;
+    ini_vector<char> &pending = stream->pending;
+
+    // Hold on to the first few bytes until it's clear whether they're a byte order mark
+    if (!stream->started) {
+        int take = (int)(3 - pending.size()) < length ? (int)(3 - pending.size()) : length;
+        pending.insert(pending.end(), bytes, bytes + take);
+        bytes += take;
+        length -= take;
+        if (pending.size() < 3) {
+            return 0;
+        }
+        stream->started = true;
+        stream->column = utf8_bom_length(buffer{ pending.data(), (int)pending.size() });
+        if (stream->column) {
+            pending.clear();
+        }
+    }
+
+    // Finish the statement left over from last time first. It's complete once a newline shows up (unless
+    // it's a [header] running over multiple lines), so only copy new input over a line at a time. Until
+    // then parsing it again would only find out it's still unfinished, which costs the whole line every
+    // time a long line comes in small pieces.
+    while (!pending.empty() && length > 0) {
+        const char *eol = ini->scan->find_eol(bytes, bytes + length);
+        bool line_end = eol < bytes + length;
+        int take = line_end ? (int)(eol - bytes) + 1 : length;
+        pending.insert(pending.end(), bytes, bytes + take);
+        bytes += take;
+        length -= take;
+        if (!line_end) {
+            return 0;
+        }
+
+        int consumed = stream_parse(stream, pending.data(), (int)pending.size());
+        if (consumed < 0) {
+            return consumed;
+        }
+        pending.erase(pending.begin(), pending.begin() + consumed);
+    }
+
+    // Everything else is parsed straight out of the caller's bytes, only the unfinished tail gets copied.
+    // Those are const, so values get unescaped into the arena even if the stream's own buffer is writable.
+    if (length > 0) {
+        bool writable = ini->writable;
+        ini->writable = false;
+        int consumed = stream_parse(stream, (char *)bytes, length);
+        ini->writable = writable;
+        if (consumed < 0) {
+            return consumed;
+        }
+        pending.insert(pending.end(), bytes + consumed, bytes + length);
+    }
+    return 0;
+}
+
+// No more input is coming, parse whatever is left over
+// Returns 0 on success, negative error code on failure (see stream->ini.error, or stream->ini.errors for every
+// error with INI_RECOVER)
+int ini_finish(ini_stream *stream)
+{
+    stream->ini.partial = false;
+    int err = 0;
+    if (!stream->pending.empty()) {
+        err = stream_parse(stream, stream->pending.data(), (int)stream->pending.size());
+        stream->pending.clear();
+    }
+    if (!stream->ini.errors.empty()) {
+        err = -1;
+    }
+    return err < 0 ? err : 0;
+}
+
+// Read file as binary, but append \0 to the end of the buffer
+// filename: name of file to read
+// buf     : if file read successfully, this will be an allocated buffer containing file contents
+// Returns 0 on success, negative error code on failure (see stderr for more info)
+// WARN: you must free(buf->data) when you're done with it!!
+int read_entire_file(const char *filename, buffer *buf)
+{
+    INI_TRACE_SCOPE("read_entire_file");
+    assert(filename);
+    assert(buf);
+
+    // Open file
+    FILE *fs = fopen(filename, "rb");
+    if (!fs) {
+        fprintf(stderr, "Unable to open %s for reading\n", filename);
+        return -1;
+    }
+
+    // Calculate length
+    fseek(fs, 0, SEEK_END);
+    long tell = ftell(fs);
+    if (tell < 0) {
+        fprintf(stderr, "Unable to determine length of %s\n", filename);
+        return -2;
+    }
+    rewind(fs);
+
+    // Error on empty file
+    assert(tell > 0);
+
+    // Allocate buffer
+    size_t buflen = (size_t)tell;
+    buf->data = (char *)calloc(1, buflen + 1);  // extra byte for nil
+    if (!buf->data) {
+        fprintf(stderr, "Failed to allocate buffer\n");
+        return -3;
+    }
+
+    // Read file into buffer
+    size_t read = fread(buf->data, 1, tell, fs);
+    if (read != buflen) {
+        free(buf->data);
+        fprintf(stderr, "Failed to read entire file\n");
+        return -4;
+    }
+
+    // Close file
+    fclose(fs);
+
+    buf->length = (int)buflen;
+    return 0;
+}
+
+// Map file into memory read-only, so the parser reads straight out of the page cache instead of a heap copy
+// filename: name of file to map
+// file    : if file mapped successfully, file->buf will point at the file contents
+// Returns 0 on success, negative error code on failure (see stderr for more info)
+// WARN: the mapping is read-only and NOT nil-terminated, and you must unmap_file(file) when you're done with it!!
+int map_entire_file(const char *filename, mapped_file *file)
+{
+    INI_TRACE_SCOPE("map_entire_file");
+    assert(filename);
+    assert(file);
+
+    *file = mapped_file{};
+
+#ifdef _WIN32
+    // Open file
+    HANDLE fh = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, 0);
+    if (fh == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "Unable to open %s for reading\n", filename);
+        return -1;
+    }
+
+    // Calculate length
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(fh, &size)) {
+        CloseHandle(fh);
+        fprintf(stderr, "Unable to determine length of %s\n", filename);
+        return -2;
+    }
+    if (size.QuadPart > INT_MAX) {
+        CloseHandle(fh);
+        fprintf(stderr, "%s is too large to parse\n", filename);
+        return -3;
+    }
+
+    // Empty files can't be mapped, but they're still valid (empty) .ini files
+    if (size.QuadPart == 0) {
+        CloseHandle(fh);
+        return 0;
+    }
+
+    // Map file into memory
+    HANDLE mapping = CreateFileMappingA(fh, 0, PAGE_READONLY, 0, 0, 0);
+    if (!mapping) {
+        CloseHandle(fh);
+        fprintf(stderr, "Failed to create file mapping for %s\n", filename);
+        return -4;
+    }
+
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(fh);
+        fprintf(stderr, "Failed to map %s into memory\n", filename);
+        return -4;
+    }
+
+    file->file = fh;
+    file->mapping = mapping;
+    file->buf.data = (char *)view;
+    file->buf.length = (int)size.QuadPart;
+#else
+    // Open file
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Unable to open %s for reading\n", filename);
+        return -1;
+    }
+
+    // Calculate length
+    struct stat st{};
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        fprintf(stderr, "Unable to determine length of %s\n", filename);
+        return -2;
+    }
+    if (st.st_size > INT_MAX) {
+        close(fd);
+        fprintf(stderr, "%s is too large to parse\n", filename);
+        return -3;
+    }
+
+    // Empty files can't be mapped, but they're still valid (empty) .ini files
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    // Map file into memory, the mapping stays valid after the descriptor is closed
+    void *view = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) {
+        fprintf(stderr, "Failed to map %s into memory\n", filename);
+        return -4;
+    }
+
+    // Parser reads the file front to back exactly once, let the kernel read ahead aggressively
+    madvise(view, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    file->buf.data = (char *)view;
+    file->buf.length = (int)st.st_size;
+#endif
+
+    return 0;
+}
+
+// Release a mapping created by map_entire_file(), any slices pointing into it are invalid afterwards
+void unmap_file(mapped_file *file)
+{
+    assert(file);
+
+    if (file->buf.data) {
+#ifdef _WIN32
+        UnmapViewOfFile(file->buf.data);
+        CloseHandle(file->mapping);
+        CloseHandle(file->file);
+#else
+        munmap(file->buf.data, (size_t)file->buf.length);
+#endif
+    }
+    *file = mapped_file{};
+}
+
+//------------------------------------------------------------------------------
+// Compressed files
+//------------------------------------------------------------------------------
+
+// Formats decompress_format() recognizes
+#define INI_FORMAT_PLAIN 0
+#define INI_FORMAT_GZIP  1
+#define INI_FORMAT_ZSTD  2
+
+// Blocks in flight between the decompression thread and the parser, enough that neither waits on the
+// other's jitter
+#define INI_DECOMPRESS_QUEUE 4
+
+// Which format buf is in, going by its magic number
+static int decompress_format(buffer buf)
+{
+    const unsigned char *p = (const unsigned char *)buf.data;
+    if (buf.length >= 2 && p[0] == 0x1f && p[1] == 0x8b) {
+        return INI_FORMAT_GZIP;
+    }
+    if (buf.length >= 4 && p[0] == 0x28 && p[1] == 0xb5 && p[2] == 0x2f && p[3] == 0xfd) {
+        return INI_FORMAT_ZSTD;
+    }
+    return INI_FORMAT_PLAIN;
+}
+
+// Incremental decoder over a whole compressed file (all of a .gz's members, all of a .zst's frames)
+struct ini_decoder {
+    int format;
+    bool done;                      // all the input has been decompressed
+#ifdef INI_ZLIB
+    z_stream z;
+#endif
+#ifdef INI_ZSTD
+    ZSTD_DStream *zstd;
+    ZSTD_inBuffer zstd_in;
+    size_t zstd_hint;               // last ZSTD_decompressStream() result, 0 at the end of a frame
+#endif
+};
+
+// Returns 0 on success, -5 if this build can't decompress format (see stderr for more info)
+static int decoder_init(ini_decoder *decoder, int format, buffer in, const char *filename)
+{
+    (void)in;                       // unused if built without any decoders
+    *decoder = ini_decoder{};
+    decoder->format = format;
+    switch (format) {
+#ifdef INI_ZLIB
+        case INI_FORMAT_GZIP: {
+            // 15 + 32: largest window, and detect the gzip header
+            if (inflateInit2(&decoder->z, 15 + 32) != Z_OK) {
+                break;
+            }
+            decoder->z.next_in = (Bytef *)in.data;
+            decoder->z.avail_in = (uInt)in.length;
+            return 0;
+        }
+#endif
+#ifdef INI_ZSTD
+        case INI_FORMAT_ZSTD: {
+            decoder->zstd = ZSTD_createDStream();
+            if (!decoder->zstd) {
+                break;
+            }
+            decoder->zstd_in = ZSTD_inBuffer{ in.data, (size_t)in.length, 0 };
+            decoder->zstd_hint = 1;
+            return 0;
+        }
+#endif
+        default: {
+            fprintf(stderr, "%s: built without support for its compression format\n", filename);
+            return -5;
+        }
+    }
+    fprintf(stderr, "%s: failed to start decompressing\n", filename);
+    return -5;
+}
+
+static void decoder_free(ini_decoder *decoder)
+{
+#ifdef INI_ZLIB
+    if (decoder->format == INI_FORMAT_GZIP) {
+        inflateEnd(&decoder->z);
+    }
+#endif
+#ifdef INI_ZSTD
+    if (decoder->format == INI_FORMAT_ZSTD) {
+        ZSTD_freeDStream(decoder->zstd);
+    }
+#endif
+    *decoder = ini_decoder{};
+}
+
+// Decompress up to size more bytes into out
+// Returns # of bytes written, short (or 0) only once decoder->done, or -6 if the data is corrupt or truncated
+static int decoder_read(ini_decoder *decoder, char *out, int size)
+{
+    (void)out;                      // unused if built without any decoders
+    (void)size;
+    int written = 0;
+    switch (decoder->format) {
+#ifdef INI_ZLIB
+        case INI_FORMAT_GZIP: {
+            z_stream &z = decoder->z;
+            z.next_out = (Bytef *)out;
+            z.avail_out = (uInt)size;
+            while (z.avail_out && !decoder->done) {
+                int ret = inflate(&z, Z_NO_FLUSH);
+                if (ret == Z_STREAM_END) {
+                    // Concatenated .gz files are one file, keep going if another member follows
+                    if (!z.avail_in) {
+                        decoder->done = true;
+                    } else if (inflateReset(&z) != Z_OK) {
+                        return -6;
+                    }
+                } else if (ret != Z_OK) {
+                    return -6;
+                }
+            }
+            written = size - (int)z.avail_out;
+            break;
+        }
+#endif
+#ifdef INI_ZSTD
+        case INI_FORMAT_ZSTD: {
+            // Frames follow each other, ZSTD_decompressStream() moves on to the next one by itself
+            ZSTD_outBuffer zout{ out, (size_t)size, 0 };
+            ZSTD_inBuffer &zin = decoder->zstd_in;
+            while (zout.pos < zout.size) {
+                if (zin.pos == zin.size && !decoder->zstd_hint) {
+                    decoder->done = true;
+                    break;
+                }
+                size_t out_before = zout.pos;
+                size_t in_before = zin.pos;
+                size_t hint = ZSTD_decompressStream(decoder->zstd, &zout, &zin);
+                if (ZSTD_isError(hint) || (zout.pos == out_before && zin.pos == in_before)) {
+                    return -6;
+                }
+                decoder->zstd_hint = hint;
+            }
+            if (zin.pos == zin.size && !decoder->zstd_hint) {
+                decoder->done = true;
+            }
+            written = (int)zout.pos;
+            break;
+        }
+#endif
+        default: {
+            assert(!"decoder_read: decoder_init() failed");
+            return -6;
+        }
+    }
+    return written;
+}
+
+// Decompressed size the file's headers claim, or 0 if they don't say. Only a hint: a .gz only has the size
+// of its last member (mod 4 GB) and a .zst may have more than one frame, buffers that turn out too small
+// get grown while decompressing.
+static size_t decompressed_size_hint(buffer in, int format)
+{
+    if (format == INI_FORMAT_GZIP && in.length >= 18) {
+        // ISIZE, little-endian, in the last 4 bytes. It's only the size mod 2^32 of the last member and
+        // nothing checks it before the end, so a value deflate can't reach (~1032:1 at best) isn't trusted
+        const unsigned char *p = (const unsigned char *)in.data + in.length - 4;
+        size_t size = (size_t)p[0] | (size_t)p[1] << 8 | (size_t)p[2] << 16 | (size_t)p[3] << 24;
+        if (size <= INT_MAX && size / 1032 <= (size_t)in.length) {
+            return size;
+        }
+    }
+#ifdef INI_ZSTD
+    if (format == INI_FORMAT_ZSTD) {
+        // Content size of the first frame, which is all of it unless the file is several frames
+        unsigned long long size = ZSTD_getFrameContentSize(in.data, (size_t)in.length);
+        if (size != ZSTD_CONTENTSIZE_UNKNOWN && size != ZSTD_CONTENTSIZE_ERROR && size <= INT_MAX) {
+            return (size_t)size;
+        }
+    }
+#endif
+    return 0;
+}
+
+// Read a .ini, .ini.gz or .ini.zst file into one buffer, decompressed, so properties can point straight
+// into it like after read_entire_file(). The buffer is allocated once at the size the file's header gives
+// (a zstd frame's content size, a gzip trailer's ISIZE), and only grown if that turns out to be wrong.
+// filename: name of file to read, the format is detected from its contents rather than its name
+// buf     : if file read successfully, this will be an allocated buffer containing the decompressed contents
+// Returns 0 on success, negative error code on failure (see stderr for more info)
+// WARN: you must free(buf->data) when you're done with it!!
+int read_compressed_file(const char *filename, buffer *buf)
+{
+    INI_TRACE_SCOPE("read_compressed_file");
+    assert(filename);
+    assert(buf);
+
+    mapped_file file{};
+    int err = map_entire_file(filename, &file);
+    if (err < 0) {
+        return err;
+    }
+    int format = decompress_format(file.buf);
+    if (format == INI_FORMAT_PLAIN) {
+        unmap_file(&file);
+        return read_entire_file(filename, buf);
+    }
+
+    ini_decoder decoder{};
+    err = decoder_init(&decoder, format, file.buf, filename);
+    if (err < 0) {
+        unmap_file(&file);
+        return err;
+    }
+
+    // +1 for the nil, which also gives the decoder room to find the end of the input in a right-sized buffer
+    size_t capacity = decompressed_size_hint(file.buf, format) + 1;
+    char *data = (char *)malloc(capacity);
+    size_t length = 0;
+    if (!data) {
+        fprintf(stderr, "Failed to allocate buffer\n");
+        err = -3;
+    }
+    while (!err && !decoder.done) {
+        if (length == capacity) {
+            char *grown = capacity <= (size_t)INT_MAX / 2 ? (char *)realloc(data, capacity * 2) : 0;
+            if (!grown) {
+                fprintf(stderr, "%s is too large to parse\n", filename);
+                err = -3;
+                break;
+            }
+            data = grown;
+            capacity *= 2;
+        }
+        size_t room = capacity - length;
+        int read = decoder_read(&decoder, data + length, room < (size_t)INT_MAX ? (int)room : INT_MAX);
+        if (read == 0 && !decoder.done) {
+            // Room to write and nothing written, the decoder needs input that isn't there
+            read = -6;
+        }
+        if (read < 0) {
+            fprintf(stderr, "%s: corrupt compressed data\n", filename);
+            err = read;
+            break;
+        }
+        length += (size_t)read;
+    }
+    decoder_free(&decoder);
+    unmap_file(&file);
+
+    if (!err && length == capacity) {
+        // The output was bigger than the headers said, and ended right at the end of the buffer
+        char *grown = length < (size_t)INT_MAX ? (char *)realloc(data, length + 1) : 0;
+        if (!grown) {
+            fprintf(stderr, "%s is too large to parse\n", filename);
+            err = -3;
+        }
+        data = grown ? grown : data;
+    }
+    if (err) {
+        free(data);
+        return err;
+    }
+    data[length] = 0;
+    buf->data = data;
+    buf->length = (int)length;
+    return 0;
+}
+
+// Blocks handed from the decompression thread to the parsing thread
+struct decompress_queue {
+    std::mutex lock;
+    std::condition_variable filled_cv;      // a block got filled, or the decoder is done
+    std::condition_variable parsed_cv;      // a block got parsed, or the parser gave up
+    std::vector<char> blocks;               // INI_DECOMPRESS_QUEUE blocks of block_size bytes
+    int lengths[INI_DECOMPRESS_QUEUE];
+    int block_size;
+    int64_t filled;                         // # of blocks decompressed so far, block n is at n % INI_DECOMPRESS_QUEUE
+    int64_t parsed;                         // # of blocks fed to the parser so far
+    bool done;                              // decoder finished, no block after filled is coming
+    bool cancel;                            // parser failed, stop decompressing
+    int error;                              // decoder_read() error
+};
+
+static void decompress_worker(decompress_queue *queue, ini_decoder *decoder)
+{
+    for (;;) {
+        int64_t n = 0;
+        {
+            std::unique_lock<std::mutex> hold(queue->lock);
+            queue->parsed_cv.wait(hold, [&]() { return queue->cancel || queue->filled - queue->parsed < INI_DECOMPRESS_QUEUE; });
+            if (queue->cancel) {
+                return;
+            }
+            n = queue->filled;
+        }
+
+        // Block n isn't the parser's until filled moves past it, so it's written without the lock
+        char *block = queue->blocks.data() + (size_t)(n % INI_DECOMPRESS_QUEUE) * queue->block_size;
+        int read = decoder_read(decoder, block, queue->block_size);
+
+        std::lock_guard<std::mutex> hold(queue->lock);
+        if (read < 0) {
+            queue->error = read;
+            queue->done = true;
+        } else {
+            queue->lengths[n % INI_DECOMPRESS_QUEUE] = read;
+            queue->filled++;
+            queue->done = decoder->done;
+        }
+        queue->filled_cv.notify_one();
+        if (queue->done) {
+            return;
+        }
+    }
+}
+
+// Parse a .ini, .ini.gz or .ini.zst file through stream, decompressing it in block_size pieces on another
+// thread while the previous pieces are parsed on this one. Neither a decompressed file nor a buffer holding
+// all of it is ever made: only the unfinished tail of each block is copied, like any ini_feed(). For
+// properties that point straight into the decompressed text, use read_compressed_file() instead.
+// filename  : name of file to parse, the format is detected from its contents rather than its name
+// stream    : set up with init_ini_stream() (flags, on_kv, ...), gets ini_finish()ed at the end
+// block_size: bytes of decompressed text per ini_feed()
+// Returns 0 on success, negative error code on failure (see stderr, and stream->ini.error for parse errors)
+int ini_load_compressed(const char *filename, ini_stream *stream, int block_size)
+{
+    INI_TRACE_SCOPE("ini_load_compressed");
+    assert(filename);
+    assert(stream);
+    assert(block_size > 0);
+
+    mapped_file file{};
+    int err = map_entire_file(filename, &file);
+    if (err < 0) {
+        return err;
+    }
+
+    int format = decompress_format(file.buf);
+    if (format == INI_FORMAT_PLAIN) {
+        err = ini_feed(stream, file.buf.data, file.buf.length);
+        unmap_file(&file);
+        return err < 0 ? err : ini_finish(stream);
+    }
+
+    ini_decoder decoder{};
+    err = decoder_init(&decoder, format, file.buf, filename);
+    if (err < 0) {
+        unmap_file(&file);
+        return err;
+    }
+
+    decompress_queue queue{};
+    queue.blocks.resize((size_t)block_size * INI_DECOMPRESS_QUEUE);
+    queue.block_size = block_size;
+    std::thread worker(decompress_worker, &queue, &decoder);
+
+    for (;;) {
+        int64_t n = 0;
+        int length = 0;
+        {
+            std::unique_lock<std::mutex> hold(queue.lock);
+            queue.filled_cv.wait(hold, [&]() { return queue.done || queue.parsed < queue.filled; });
+            if (queue.parsed == queue.filled) {
+                break;
+            }
+            n = queue.parsed;
+            length = queue.lengths[n % INI_DECOMPRESS_QUEUE];
+        }
+
+        err = ini_feed(stream, queue.blocks.data() + (size_t)(n % INI_DECOMPRESS_QUEUE) * block_size, length);
+
+        std::lock_guard<std::mutex> hold(queue.lock);
+        queue.parsed++;
+        queue.cancel = err < 0;
+        queue.parsed_cv.notify_one();
+        if (err < 0) {
+            break;
+        }
+    }
+    worker.join();
+    decoder_free(&decoder);
+    unmap_file(&file);
+
+    if (err < 0) {
+        return err;
+    }
+    if (queue.error < 0) {
+        fprintf(stderr, "%s: corrupt compressed data\n", filename);
+        return queue.error;
+    }
+    return ini_finish(stream);
+}
+
+//------------------------------------------------------------------------------
+// Binary cache
+//------------------------------------------------------------------------------
+
+// FNV-1a, 64-bit since it has to tell whole files apart
+static uint64_t hash_buffer(const char *data, size_t length)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)data[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Size and last write time of a file, without opening it
+// Returns 0 on success, -1 if the file doesn't exist (or can't be stat'd)
+static int stat_file(const char *filename, ini_cache_key *key)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA attr{};
+    if (!GetFileAttributesExA(filename, GetFileExInfoStandard, &attr)) {
+        return -1;
+    }
+    key->size = ((uint64_t)attr.nFileSizeHigh << 32) | attr.nFileSizeLow;
+    key->mtime = (int64_t)(((uint64_t)attr.ftLastWriteTime.dwHighDateTime << 32) | attr.ftLastWriteTime.dwLowDateTime);
+#else
+    struct stat st{};
+    if (stat(filename, &st) < 0) {
+        return -1;
+    }
+    key->size = (uint64_t)st.st_size;
+#ifdef __APPLE__
+    key->mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    key->mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+#endif
+    return 0;
+}
+
+// Serialize the properties of a parser into a cache file that load_ini_cached() can use with zero parsing.
+// The file is written next to filename and renamed over it, so concurrent readers never see half of it.
+// ini: parsed with parse_ini() (or any of the whole-buffer parsers) into ini->properties
+// key: identifies ini->buf, see stat_file()
+// Returns 0 on success, negative error code on failure (see stderr for more info)
+int write_ini_cache(const ini_parser *ini, const char *filename, const ini_cache_key *key)
+{
+    INI_TRACE_SCOPE("write_ini_cache");
+    assert(ini);
+    assert(filename);
+    assert(key);
+
+    for (const ini_kv &kv : ini->properties) {
+        if (kv.flags & INI_VALUE_SPILLED) {
+            fprintf(stderr, "Can't cache values that were unescaped outside of the buffer\n");
+            return -4;
+        }
+    }
+
+    const char *pool = ini->buf.data;
+    auto offset_of = [&](slice s) {
+        assert(!s.length || (s.data >= pool && s.data + s.length <= pool + ini->buf.length));
+        return s.data ? (uint32_t)(s.data - pool) : INI_CACHE_NIL;
+    };
+
+    // Each run of properties from the same header shares one section table entry
+    std::vector<ini_cache_section> sections;
+    std::vector<ini_cache_property> properties;
+    properties.reserve(ini->properties.size());
+    slice last{};
+    for (const ini_kv &kv : ini->properties) {
+        if (sections.empty() || kv.section.data != last.data || kv.section.length != last.length) {
+            sections.push_back(ini_cache_section{ offset_of(kv.section), (uint32_t)kv.section.length });
+            last = kv.section;
+        }
+        properties.push_back(ini_cache_property{
+            (uint32_t)sections.size() - 1,
+            offset_of(kv.key), (uint32_t)kv.key.length,
+            offset_of(kv.value), (uint32_t)kv.value.length,
+            (uint32_t)kv.flags
+        });
+    }
+    sections.push_back(ini_cache_section{ offset_of(ini->section), (uint32_t)ini->section.length });
+
+    ini_cache_header header{};
+    memcpy(header.magic, INI_CACHE_MAGIC, sizeof(header.magic));
+    header.version = INI_CACHE_VERSION;
+    header.key = *key;
+    header.section_count = (uint32_t)sections.size();
+    header.property_count = (uint32_t)properties.size();
+    header.pool_offset = (uint32_t)(sizeof(header) + sections.size() * sizeof(ini_cache_section) +
+        properties.size() * sizeof(ini_cache_property));
+    header.pool_length = (uint32_t)ini->buf.length;
+    header.line = (uint32_t)ini->line;
+    header.section = header.section_count - 1;
+    header.flags = (uint32_t)(ini->flags & INI_CACHE_FLAGS);
+
+    std::vector<char> tmp_name(filename, filename + strlen(filename));
+    const char suffix[] = ".tmp";
+    tmp_name.insert(tmp_name.end(), suffix, suffix + sizeof(suffix));
+
+    FILE *fs = fopen(tmp_name.data(), "wb");
+    if (!fs) {
+        fprintf(stderr, "Unable to open %s for writing\n", tmp_name.data());
+        return -1;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, fs) == 1;
+    ok = ok && fwrite(sections.data(), sizeof(ini_cache_section), sections.size(), fs) == sections.size();
+    ok = ok && fwrite(properties.data(), sizeof(ini_cache_property), properties.size(), fs) == properties.size();
+    ok = ok && fwrite(pool, 1, ini->buf.length, fs) == (size_t)ini->buf.length;
+    ok = (fclose(fs) == 0) && ok;
+    if (!ok) {
+        remove(tmp_name.data());
+        fprintf(stderr, "Failed to write %s\n", tmp_name.data());
+        return -2;
+    }
+
+#ifdef _WIN32
+    ok = MoveFileExA(tmp_name.data(), filename, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    ok = rename(tmp_name.data(), filename) == 0;
+#endif
+    if (!ok) {
+        remove(tmp_name.data());
+        fprintf(stderr, "Failed to replace %s\n", filename);
+        return -3;
+    }
+    return 0;
+}
+
+// Check everything in a mapped cache file points where it should, so a truncated or corrupt cache is
+// treated as stale instead of handing out slices into nowhere
+static bool cache_valid(const buffer &blob)
+{
+    if ((size_t)blob.length < sizeof(ini_cache_header)) {
+        return false;
+    }
+    ini_cache_header header;
+    memcpy(&header, blob.data, sizeof(header));
+    if (memcmp(header.magic, INI_CACHE_MAGIC, sizeof(header.magic)) || header.version != INI_CACHE_VERSION) {
+        return false;
+    }
+    uint64_t tables = sizeof(header) + (uint64_t)header.section_count * sizeof(ini_cache_section) +
+        (uint64_t)header.property_count * sizeof(ini_cache_property);
+    if (!header.section_count || header.section >= header.section_count || header.pool_offset != tables ||
+        tables + header.pool_length != (uint64_t)blob.length || header.pool_length != header.key.size) {
+        return false;
+    }
+
+    auto in_pool = [&](uint32_t offset, uint32_t length) {
+        return (uint64_t)offset + length <= header.pool_length;
+    };
+    const ini_cache_section *sections = (const ini_cache_section *)(blob.data + sizeof(header));
+    const ini_cache_property *properties = (const ini_cache_property *)(sections + header.section_count);
+    for (uint32_t i = 0; i < header.section_count; i++) {
+        if (sections[i].offset == INI_CACHE_NIL ? sections[i].length != 0 : !in_pool(sections[i].offset, sections[i].length)) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header.property_count; i++) {
+        const ini_cache_property &p = properties[i];
+        if (p.section >= header.section_count || !in_pool(p.key_offset, p.key_length) ||
+            !in_pool(p.value_offset, p.value_length) ||
+            (p.flags & ~(uint32_t)(INI_VALUE_QUOTED | INI_VALUE_IN_PLACE))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Rebuild a parser's results from a validated cache file, as if parse_ini() had just run over the pool.
+// Properties go through the normal store path, so the parser's flags and visitor apply.
+static int load_ini_cache(ini_parser *ini, const buffer &blob, ini_arena *arena)
+{
+    ini_cache_header header;
+    memcpy(&header, blob.data, sizeof(header));
+    const ini_cache_section *sections = (const ini_cache_section *)(blob.data + sizeof(header));
+    const ini_cache_property *properties = (const ini_cache_property *)(sections + header.section_count);
+    char *pool = blob.data + header.pool_offset;
+    auto section_name = [&](uint32_t s) {
+        const ini_cache_section &section = sections[s];
+        return section.offset == INI_CACHE_NIL ? slice{} : slice{ pool + section.offset, (int)section.length };
+    };
+
+    // Nothing to scan, the exact property count is right there
+    init_ini(ini, buffer{}, arena);
+    ini->buf = buffer{ pool, (int)header.pool_length };
+    ini->estimated_properties = (int)header.property_count;
+
+    uint32_t current = INI_CACHE_NIL;
+    for (uint32_t i = 0; i < header.property_count; i++) {
+        const ini_cache_property &p = properties[i];
+        int err = 0;
+        if (p.section != current) {
+            current = p.section;
+            slice name = section_name(current);
+            if (name.data) {
+                err = emit_section(ini, name);
+            } else {
+                ini->section = slice{};
+                ini->section_index = 0;
+            }
+        }
+        if (!err) {
+            err = store_kv(ini, ini_kv{ ini->section, slice{ pool + p.key_offset, (int)p.key_length },
+                slice{ pool + p.value_offset, (int)p.value_length }, (int)p.flags });
+        }
+        if (err) {
+            return err;
+        }
+    }
+
+    ini->section = section_name(header.section);
+    ini->line = (int)header.line;
+    ini->cursor = ini->buf.length;
+    return 0;
+}
+
+// Load a .ini file through a binary cache. If cache_filename was built from the file's current contents,
+// the parser is filled straight from the mapped cache with zero parsing. Otherwise the file is read with
+// read_entire_file() and parsed with parse_ini(), and the cache is (re)written for next time (failing to
+// write it isn't an error, e.g. read-only config directories).
+// Set ini->flags/quiet/visitor beforehand, init_ini() is called with arena for you.
+// The cache counts as fresh if the file's size and mtime match, or if only the mtime differs (e.g. the
+// file was copied) but the contents hash the same, and only if it was built with the same INI_CACHE_FLAGS.
+// file: backs the parser's slices, see ini_cached_file::hit for where they came from
+// Returns 0 on success, negative error code on failure (see stderr for more info)
+// WARN: you must free_ini_cached(file) when you're done with the parser!!
+int load_ini_cached(const char *filename, const char *cache_filename, ini_parser *ini, ini_cached_file *file,
+    ini_arena *arena)
+{
+    INI_TRACE_SCOPE("load_ini_cached");
+    assert(filename);
+    assert(cache_filename);
+    assert(ini);
+    assert(file);
+
+    *file = ini_cached_file{};
+    INI_STAT(int64_t io_start = stats_now());
+
+    ini_cache_key key{};
+    if (stat_file(filename, &key) < 0) {
+        fprintf(stderr, "Unable to open %s for reading\n", filename);
+        return -1;
+    }
+
+    ini_cache_key cached{};
+    bool rewrite = false;
+    if (stat_file(cache_filename, &cached) == 0 && map_entire_file(cache_filename, &file->cache) == 0) {
+        // A cache parsed with other flags (quoting, validation) holds other properties, same as a stale one
+        bool usable = cache_valid(file->cache.buf);
+        if (usable) {
+            uint32_t flags;
+            memcpy(&flags, file->cache.buf.data + offsetof(ini_cache_header, flags), sizeof(flags));
+            usable = flags == (uint32_t)(ini->flags & INI_CACHE_FLAGS);
+        }
+        if (usable) {
+            memcpy(&cached, file->cache.buf.data + offsetof(ini_cache_header, key), sizeof(cached));
+            if (cached.size == key.size && cached.mtime != key.mtime) {
+                // Same size but touched since, only a content hash can tell whether it really changed
+                if (key.size && read_entire_file(filename, &file->source) < 0) {
+                    unmap_file(&file->cache);
+                    return -1;
+                }
+                key.hash = hash_buffer(file->source.data, (size_t)file->source.length);
+                if (key.hash == cached.hash) {
+                    cached.mtime = key.mtime;
+                    rewrite = true;
+                }
+            }
+            if (cached.size == key.size && cached.mtime == key.mtime) {
+                INI_STAT(int64_t io_ns = stats_now() - io_start);
+                int err = load_ini_cache(ini, file->cache.buf, arena);
+                INI_STAT(ini->stats.io_ns += io_ns);
+                if (err < 0) {
+                    return err;
+                }
+                file->hit = true;
+                if (rewrite) {
+                    // Record the new mtime so the next load doesn't have to hash (the old cache stays
+                    // mapped until we're done with it)
+                    key.hash = cached.hash;
+                    write_ini_cache(ini, cache_filename, &key);
+                }
+                free(file->source.data);
+                file->source = buffer{};
+                return 0;
+            }
+        }
+        unmap_file(&file->cache);
+    }
+
+    // Stale or missing, parse the file and replace the cache
+    if (!file->source.data && key.size) {
+        int err = read_entire_file(filename, &file->source);
+        if (err < 0) {
+            return err;
+        }
+        key.hash = hash_buffer(file->source.data, (size_t)file->source.length);
+    } else if (!key.size) {
+        key.hash = hash_buffer(0, 0);
+    }
+
+    init_ini(ini, file->source, arena);
+    INI_STAT(ini->stats.io_ns += stats_now() - io_start);
+    ini->writable = true;
+    int err = parse_ini(ini);
+    if (err < 0) {
+        return err;
+    }
+    write_ini_cache(ini, cache_filename, &key);
+    return 0;
+}
+
+// Release whatever the slices of a parser filled by load_ini_cached() point into
+void free_ini_cached(ini_cached_file *file)
+{
+    assert(file);
+
+    unmap_file(&file->cache);
+    free(file->source.data);
+    *file = ini_cached_file{};
+}
+
+//------------------------------------------------------------------------------
+// Writer
+//------------------------------------------------------------------------------
+
+// Start editing the file ini was parsed from
+void init_ini_writer(ini_writer *writer, ini_parser *ini)
+{
+    assert(writer);
+    assert(ini);
+
+    writer->ini = ini;
+    writer->edits.clear();
+    init_arena(&writer->strings);
+}
+
+// Drop every edit and the text that went with them
+void free_ini_writer(ini_writer *writer)
+{
+    assert(writer);
+
+    free_arena(&writer->strings);
+    *writer = ini_writer{};
+}
+
+static slice writer_copy(ini_writer *writer, const char *bytes, int length)
+{
+    char *copy = (char *)arena_alloc(&writer->strings, length ? length : 1, 1);
+    if (!copy) {
+        throw std::bad_alloc();
+    }
+    memcpy(copy, bytes, length);
+    return slice{ copy, length };
+}
+
+static bool has_char(slice s, char c)
+{
+    return s.length && memchr(s.data, c, s.length) != 0;
+}
+
+static bool is_blank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+// Keys can't be empty, contain '=' or newlines, have whitespace around them or look like a header/comment
+static bool writable_key(slice key)
+{
+    if (!key.length || is_blank(key.data[0]) || is_blank(key.data[key.length - 1])) {
+        return false;
+    }
+    if (key.data[0] == '[' || key.data[0] == ';') {
+        return false;
+    }
+    return !has_char(key, '=') && !has_char(key, '\r') && !has_char(key, '\n');
+}
+
+static bool writable_section(slice section)
+{
+    return !has_char(section, ']') && !has_char(section, '\r') && !has_char(section, '\n');
+}
+
+// value as it has to be written so it reads back the same, or a nil slice if it can't be. With
+// INI_QUOTED_VALUES anything can, anything that would otherwise be mangled gets quoted and escaped. Without
+// it values can't be empty, span lines or start or end with whitespace.
+static slice writer_value(ini_writer *writer, slice value)
+{
+    const char *p = value.data;
+    int n = value.length;
+    bool blank_edge = n && (is_blank(p[0]) || is_blank(p[n - 1]));
+    bool newline = has_char(value, '\r') || has_char(value, '\n');
+    if (!(writer->ini->flags & INI_QUOTED_VALUES)) {
+        if (!n || blank_edge || newline) {
+            return slice{};
+        }
+        return writer_copy(writer, p, n);
+    }
+
+    if (n && !blank_edge && !newline && p[0] != '"' && !has_char(value, ';') && !has_char(value, '\0')) {
+        return writer_copy(writer, p, n);
+    }
+    char *out = (char *)arena_alloc(&writer->strings, (size_t)n * 2 + 2, 1);
+    if (!out) {
+        throw std::bad_alloc();
+    }
+    int length = 0;
+    out[length++] = '"';
+    for (int i = 0; i < n; i++) {
+        char c = p[i];
+        switch (c) {
+            case '\\': out[length++] = '\\'; break;
+            case '"':  out[length++] = '\\'; break;
+            case '\n': out[length++] = '\\'; c = 'n'; break;
+            case '\r': out[length++] = '\\'; c = 'r'; break;
+            case '\0': out[length++] = '\\'; c = '0'; break;
+        }
+        out[length++] = c;
+    }
+    out[length++] = '"';
+    return slice{ out, length };
+}
+
+static int add_edit(ini_writer *writer, slice section, slice key, slice value)
+{
+    ini_edit edit{};
+    edit.section = writer_copy(writer, section.data, section.length);
+    edit.key = writer_copy(writer, key.data, key.length);
+    edit.value = value;
+    edit.order = (int)writer->edits.size();
+    writer->edits.push_back(edit);
+    return 0;
+}
+
+// Set [section] key to value, replacing the value of the property ini_get() would find or adding a new one
+// section: empty for properties before any [section] header
+// Returns 0 on success, -1 if the section, key or value can't be written so that it reads back the same
+int ini_set(ini_writer *writer, slice section, slice key, slice value)
+{
+    assert(writer);
+
+    if (!writable_section(section) || !writable_key(key)) {
+        return -1;
+    }
+    slice text = writer_value(writer, value);
+    if (!text.data) {
+        return -1;
+    }
+    return add_edit(writer, section, key, text);
+}
+
+int ini_set(ini_writer *writer, const char *section, const char *key, const char *value)
+{
+    assert(section);
+    assert(key);
+    assert(value);
+    return ini_set(writer, slice{ (char *)section, (int)strlen(section) }, slice{ (char *)key, (int)strlen(key) },
+        slice{ (char *)value, (int)strlen(value) });
+}
+
+// Remove [section] key, every line that sets it (so an earlier one doesn't take over)
+// Returns 0 on success (including if there is no such property), -1 if it isn't a valid key
+int ini_remove(ini_writer *writer, slice section, slice key)
+{
+    assert(writer);
+
+    if (!writable_section(section) || !writable_key(key)) {
+        return -1;
+    }
+    return add_edit(writer, section, key, slice{});
+}
+
+int ini_remove(ini_writer *writer, const char *section, const char *key)
+{
+    assert(section);
+    assert(key);
+    return ini_remove(writer, slice{ (char *)section, (int)strlen(section) }, slice{ (char *)key, (int)strlen(key) });
+}
+
+// Edits grouped by section, then key, then in the order they were made
+static bool edit_less(const ini_edit &a, const ini_edit &b)
+{
+    int c = compare_slices(a.section, b.section);
+    if (!c) {
+        c = compare_slices(a.key, b.key);
+    }
+    return c ? c < 0 : a.order < b.order;
+}
+
+// Offset just past the newline ending the line pos is on, or length if it's the last line
+static int writer_line_end(const ini_parser *ini, int pos)
+{
+    const char *data = ini->buf.data;
+    int length = ini->buf.length;
+    int eol = (int)(ini->scan->find_eol(data + pos, data + length) - data);
+    if (eol == length) {
+        return length;
+    }
+    return data[eol] == '\r' && eol + 1 < length && data[eol + 1] == '\n' ? eol + 2 : eol + 1;
+}
+
+static int writer_line_begin(const ini_parser *ini, int pos)
+{
+    const char *data = ini->buf.data;
+    while (pos > 0 && data[pos - 1] != '\n' && data[pos - 1] != '\r') {
+        pos--;
+    }
+    return pos;
+}
+
+// Where kv's value is in buf: with its quotes if it had them, without the whitespace or ; comment around it
+static void writer_value_span(const ini_parser *ini, const ini_kv &kv, int *begin, int *end)
+{
+    const char *data = ini->buf.data;
+    int length = ini->buf.length;
+    int pos = (int)(kv.key.data - data) + kv.key.length;
+    while (pos < length && data[pos] != '=') {
+        pos++;
+    }
+    pos++;
+    while (pos < length && is_blank(data[pos])) {
+        pos++;
+    }
+    int eol = (int)(ini->scan->find_eol(data + pos, data + length) - data);
+    *begin = pos;
+    if (kv.flags & INI_VALUE_QUOTED) {
+        int close = pos + 1;
+        while (close < eol && data[close] != '"') {
+            close += data[close] == '\\' ? 2 : 1;
+        }
+        *end = close + 1;
+    } else {
+        if (ini->flags & INI_QUOTED_VALUES) {
+            eol = (int)(ini->scan->find_char(data + pos, data + eol, ';') - data);
+        }
+        *end = trim_whitespace_right(data, pos, eol);
+    }
+}
+
+// Offset just past the line of the last [name] header in buf, -1 if there isn't one
+static int writer_find_header(const ini_parser *ini, slice name)
+{
+    const char *data = ini->buf.data;
+    int length = ini->buf.length;
+    int found = -1;
+    for (int pos = 0; pos < length; ) {
+        while (pos < length && is_blank(data[pos])) {
+            pos++;
+        }
+        if (pos < length && data[pos] == '[') {
+            int close = (int)(ini->scan->find_char(data + pos + 1, data + length, ']') - data);
+            if (close < length && slice_equal(slice{ (char *)data + pos + 1, close - pos - 1 }, name)) {
+                found = writer_line_end(ini, close);
+            }
+        }
+        pos = writer_line_end(ini, pos);
+    }
+    return found;
+}
+
+static void append(std::vector<char> *text, slice s)
+{
+    text->insert(text->end(), s.data, s.data + s.length);
+}
+
+static void append(std::vector<char> *text, const char *s)
+{
+    text->insert(text->end(), s, s + strlen(s));
+}
+
+// One replacement of buf[begin, end)
+struct writer_splice {
+    int begin;
+    int end;
+    slice text;
+    int order;                      // ini_edit::order, keeps insertions at the same offset in edit order
+};
+
+static bool splice_less(const writer_splice &a, const writer_splice &b)
+{
+    if (a.begin != b.begin) {
+        return a.begin < b.begin;
+    }
+    if (a.end != b.end) {
+        return a.end < b.end;
+    }
+    return a.order < b.order;
+}
+
+// The edited file as a gather list: ranges of buf that didn't change, with the edited text in between.
+// out: cleared first, then filled with slices into buf and writer->strings, in file order
+// Returns 0 on success, -1 if the parser can't be written back (a property doesn't point into buf, or its
+// value was unescaped over buf)
+int ini_write_gather(ini_writer *writer, std::vector<slice> *out)
+{
+    assert(writer);
+    assert(out);
+
+    ini_parser *ini = writer->ini;
+    const char *data = ini->buf.data;
+    int length = ini->buf.length;
+    out->clear();
+    for (const ini_kv &kv : ini->properties) {
+        if ((kv.flags & INI_VALUE_IN_PLACE) || kv.key.data < data || kv.key.data + kv.key.length > data + length) {
+            return -1;
+        }
+    }
+
+    // Only the last edit of each property counts
+    std::vector<ini_edit> edits;
+    {
+        std::vector<ini_edit> sorted(writer->edits);
+        std::sort(sorted.begin(), sorted.end(), edit_less);
+        for (size_t i = 0; i < sorted.size(); i++) {
+            if (i + 1 == sorted.size() || compare_slices(sorted[i].section, sorted[i + 1].section) ||
+                compare_slices(sorted[i].key, sorted[i + 1].key)) {
+                edits.push_back(sorted[i]);
+            }
+        }
+    }
+
+    // New lines use whatever the file uses
+    const char *eol = ini->scan->find_eol(data, data + length);
+    const char *newline = eol + 1 < data + length && eol[0] == '\r' && eol[1] == '\n' ? "\r\n" : "\n";
+    bool ends_in_newline = length && (data[length - 1] == '\n' || data[length - 1] == '\r');
+
+    std::vector<writer_splice> splices;
+    bool removes = false;
+    std::vector<ini_edit> added;
+    for (const ini_edit &edit : edits) {
+        if (!edit.value.data) {
+            removes = true;
+            continue;
+        }
+        int kv = ini_find(ini, edit.section, edit.key);
+        if (kv < 0) {
+            added.push_back(edit);
+            continue;
+        }
+        writer_splice splice{};
+        writer_value_span(ini, ini->properties[kv], &splice.begin, &splice.end);
+        splice.text = edit.value;
+        splice.order = edit.order;
+        splices.push_back(splice);
+    }
+
+    // Removed properties take every line that sets them
+    if (removes) {
+        for (const ini_kv &kv : ini->properties) {
+            ini_edit probe{ kv.section, kv.key, slice{}, -1 };
+            auto it = std::lower_bound(edits.begin(), edits.end(), probe, edit_less);
+            if (it != edits.end() && !it->value.data && slice_equal(it->section, kv.section) && slice_equal(it->key, kv.key)) {
+                int pos = (int)(kv.key.data - data);
+                splices.push_back(writer_splice{ writer_line_begin(ini, pos), writer_line_end(ini, pos), slice{}, it->order });
+            }
+        }
+    }
+
+    // New properties go after the last property of their section, or its header. Sections that aren't
+    // in the file yet get added at the end, in the order they were first edited.
+    bool appends_to_end = false;
+    for (size_t first = 0; first < added.size(); ) {
+        size_t last = first;
+        while (last < added.size() && slice_equal(added[last].section, added[first].section)) {
+            last++;
+        }
+        std::sort(added.begin() + first, added.begin() + last,
+            [](const ini_edit &a, const ini_edit &b) { return a.order < b.order; });
+        slice section = added[first].section;
+
+        int pos = -1;
+        for (int i = (int)ini->properties.size() - 1; i >= 0 && pos < 0; i--) {
+            const ini_kv &kv = ini->properties[i];
+            if (slice_equal(kv.section, section)) {
+                pos = writer_line_end(ini, (int)(kv.key.data - data));
+            }
+        }
+        if (pos < 0) {
+            pos = section.length ? writer_find_header(ini, section) : utf8_bom_length(ini->buf);
+        }
+
+        std::vector<char> text;
+        if (pos < 0) {
+            if (length) {
+                append(&text, newline);
+            }
+            append(&text, "[");
+            append(&text, section);
+            append(&text, "]");
+            append(&text, newline);
+            pos = length;
+        }
+        for (size_t i = first; i < last; i++) {
+            append(&text, added[i].key);
+            append(&text, "=");
+            append(&text, added[i].value);
+            append(&text, newline);
+        }
+        splices.push_back(writer_splice{ pos, pos, writer_copy(writer, text.data(), (int)text.size()), added[first].order });
+        appends_to_end |= pos == length;
+        first = last;
+    }
+
+    // Anything added at the end starts on a line of its own
+    if (appends_to_end && length && !ends_in_newline) {
+        splices.push_back(writer_splice{ length, length, writer_copy(writer, newline, (int)strlen(newline)), -1 });
+    }
+
+    std::sort(splices.begin(), splices.end(), splice_less);
+    int pos = 0;
+    for (const writer_splice &splice : splices) {
+        assert(splice.begin >= pos);
+        if (splice.begin > pos) {
+            out->push_back(slice{ ini->buf.data + pos, splice.begin - pos });
+        }
+        if (splice.text.length) {
+            out->push_back(splice.text);
+        }
+        pos = splice.end;
+    }
+    if (pos < length) {
+        out->push_back(slice{ ini->buf.data + pos, length - pos });
+    }
+    return 0;
+}
+
+#ifndef _WIN32
+// writev() all of slices, as many at a time as the OS takes
+static bool write_gathered(int fd, const slice *slices, size_t count)
+{
+#ifdef IOV_MAX
+    const size_t max_iov = IOV_MAX;
+#else
+    const size_t max_iov = 1024;
+#endif
+    std::vector<iovec> iov;
+    size_t next = 0;
+    size_t offset = 0;              // bytes of slices[next] already written
+    while (next < count) {
+        iov.clear();
+        for (size_t i = next; i < count && iov.size() < max_iov; i++) {
+            size_t skip = i == next ? offset : 0;
+            iov.push_back(iovec{ slices[i].data + skip, (size_t)slices[i].length - skip });
+        }
+        ssize_t written = writev(fd, iov.data(), (int)iov.size());
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        size_t left = (size_t)written;
+        while (next < count && left >= (size_t)slices[next].length - offset) {
+            left -= (size_t)slices[next].length - offset;
+            offset = 0;
+            next++;
+        }
+        offset += left;
+    }
+    return true;
+}
+#endif
+
+// Write the edited file to filename: through a temporary file next to it that's renamed over it, so readers
+// never see half of it. Unchanged parts go to the OS straight out of buf, nothing is assembled in memory.
+// Returns 0 on success, -1 if the parser can't be written back (see ini_write_gather()), or another negative
+// error code (see stderr for more info)
+int ini_write_file(ini_writer *writer, const char *filename)
+{
+    assert(filename);
+
+    std::vector<slice> gather;
+    int err = ini_write_gather(writer, &gather);
+    if (err < 0) {
+        return err;
+    }
+
+    std::vector<char> tmp_name(filename, filename + strlen(filename));
+    const char suffix[] = ".tmp";
+    tmp_name.insert(tmp_name.end(), suffix, suffix + sizeof(suffix));
+
+#ifdef _WIN32
+    // WriteFileGather() only takes page-sized, page-aligned buffers on an unbuffered handle, so each piece
+    // is written in turn instead (the data is only ever copied into the page cache either way)
+    HANDLE file = CreateFileA(tmp_name.data(), GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+    if (file == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "Unable to open %s for writing\n", tmp_name.data());
+        return -2;
+    }
+    bool ok = true;
+    for (size_t i = 0; i < gather.size() && ok; i++) {
+        DWORD written = 0;
+        ok = WriteFile(file, gather[i].data, (DWORD)gather[i].length, &written, 0) && written == (DWORD)gather[i].length;
+    }
+    ok = CloseHandle(file) && ok;
+#else
+    // Keep the permissions of the file being replaced
+    struct stat st;
+    mode_t mode = stat(filename, &st) == 0 ? (st.st_mode & 07777) : 0644;
+    int fd = open(tmp_name.data(), O_WRONLY | O_CREAT | O_TRUNC, mode);
+    if (fd < 0) {
+        fprintf(stderr, "Unable to open %s for writing\n", tmp_name.data());
+        return -2;
+    }
+    bool ok = write_gathered(fd, gather.data(), gather.size());
+    ok = (close(fd) == 0) && ok;
+#endif
+    if (!ok) {
+        remove(tmp_name.data());
+        fprintf(stderr, "Failed to write %s\n", tmp_name.data());
+        return -3;
+    }
+
+#ifdef _WIN32
+    ok = MoveFileExA(tmp_name.data(), filename, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    ok = rename(tmp_name.data(), filename) == 0;
+#endif
+    if (!ok) {
+        remove(tmp_name.data());
+        fprintf(stderr, "Failed to replace %s\n", filename);
+        return -4;
+    }
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Shared snapshots
+//------------------------------------------------------------------------------
+
+static void free_ini_snapshot(ini_snapshot *snapshot)
+{
+    free(snapshot->ini.buf.data);
+    free_arena(&snapshot->ini.strings);
+    delete snapshot;
+}
+
+// Build everything readers would otherwise build lazily, so nobody writes to a published snapshot
+static void seal_ini_snapshot(ini_snapshot *snapshot)
+{
+    if (!(snapshot->ini.flags & INI_NO_PROPERTIES)) {
+        update_ini_lookup(&snapshot->ini);
+    }
+    group_ini_sections(&snapshot->ini);
+}
+
+// Replace the config readers of shared see with a finished parse. Readers still holding the previous
+// snapshot keep it until they next call ini_read(), it's freed by whichever thread lets go of it last.
+// Only one thread may publish to shared at a time.
+// ini: moved into the snapshot and reset. ini->buf has to be malloc()ed (e.g. by read_entire_file()), the
+//      snapshot frees it, and ini->arena must be nil, the snapshot outlives whatever arena the caller has.
+// Returns the version of the new snapshot
+int ini_publish(ini_shared *shared, ini_parser *ini)
+{
+    assert(shared);
+    assert(ini);
+    assert(!ini->arena);
+
+    std::shared_ptr<ini_snapshot> next(new ini_snapshot{}, free_ini_snapshot);
+    next->ini = std::move(*ini);
+    *ini = ini_parser{};
+    seal_ini_snapshot(next.get());
+    next->version = shared->version.load(std::memory_order_relaxed) + 1;
+
+    std::atomic_store(&shared->snapshot, next);
+    shared->version.store(next->version, std::memory_order_release);
+    return next->version;
+}
+
+// Latest snapshot published to shared, or nil if there hasn't been one. Takes a reference on the shared
+// refcount, threads that read all the time should use an ini_reader instead.
+std::shared_ptr<ini_snapshot> ini_shared_snapshot(const ini_shared *shared)
+{
+    assert(shared);
+    return std::atomic_load(&shared->snapshot);
+}
+
+// WARN: reader holds on to a snapshot, let go of it (*reader = ini_reader{}) before shared goes away!!
+void init_ini_reader(ini_reader *reader, const ini_shared *shared)
+{
+    assert(reader);
+    assert(shared);
+
+    *reader = ini_reader{};
+    reader->shared = shared;
+}
+
+// Snapshot this thread should read, the latest one published as of this call, or nil if there hasn't been
+// one. When nothing was published since the last call this is one atomic load and no writes, the snapshot
+// (and everything in it) stays valid until the next call on this reader.
+const ini_snapshot *ini_read(ini_reader *reader)
+{
+    assert(reader);
+    assert(reader->shared);
+
+    if (reader->shared->version.load(std::memory_order_acquire) != reader->version) {
+        reader->snapshot = std::atomic_load(&reader->shared->snapshot);
+        reader->version = reader->snapshot ? reader->snapshot->version : 0;
+    }
+    return reader->snapshot.get();
+}
+
+// Returns value of [section] key in snapshot, or an empty slice (data == 0) if there is no such property
+slice ini_snapshot_get(const ini_snapshot *snapshot, slice section, slice key)
+{
+    assert(snapshot);
+
+    // The lookup table was completed before publishing, so ini_get() only reads
+    return ini_get((ini_parser *)&snapshot->ini, section, key);
+}
+
+slice ini_snapshot_get(const ini_snapshot *snapshot, const char *section, const char *key)
+{
+    assert(snapshot);
+    return ini_get((ini_parser *)&snapshot->ini, section, key);
+}
+
+//------------------------------------------------------------------------------
+// Watcher
+//------------------------------------------------------------------------------
+
+// Latest published parse of paths[file] given to start_ini_watcher(), or nil if it never loaded successfully.
+// Never blocks on a reload in progress, the returned snapshot stays valid for as long as it's held even if
+// a newer one gets published in the meantime.
+std::shared_ptr<ini_snapshot> ini_watch_snapshot(const ini_watcher *watcher, int file)
+{
+    assert(watcher);
+    assert(file >= 0 && file < (int)watcher->files.size());
+    return std::atomic_load(&watcher->files[file].snapshot);
+}
+
+// Re-read and re-parse files[index], then publish the result if anything changed
+// Bad edits (parse errors, file gone half way through a rename) keep the previous snapshot published
+static void watch_reload(ini_watcher *watcher, int index)
+{
+    ini_watch_file *file = &watcher->files[index];
+    file->dirty = false;
+
+    ini_cache_key key{};
+    if (stat_file(file->path.data(), &key) < 0) {
+        return;
+    }
+    buffer buf{};
+    if (key.size && read_entire_file(file->path.data(), &buf) < 0) {
+        return;
+    }
+    file->key = key;
+
+    std::shared_ptr<ini_snapshot> prev = std::atomic_load(&file->snapshot);
+    std::shared_ptr<ini_snapshot> next(new ini_snapshot{}, free_ini_snapshot);
+    std::vector<ini_change> changes;
+    int err = 0;
+    if (prev) {
+        err = reload_ini(&prev->ini, buf, &next->ini, &changes);
+    } else {
+        init_ini(&next->ini, buf);
+        next->ini.writable = true;
+        next->ini.flags = watcher->flags;
+        next->ini.quiet = watcher->quiet;
+        err = parse_ini(&next->ini);
+    }
+    if (err < 0 || (prev && changes.empty())) {
+        // Broken, or nothing ini_get() could tell apart (whitespace, comments, touch)
+        free(buf.data);
+        next->ini.buf = buffer{};
+        return;
+    }
+
+    seal_ini_snapshot(next.get());
+    next->version = prev ? prev->version + 1 : 1;
+
+    std::atomic_store(&file->snapshot, next);
+    if (watcher->on_reload) {
+        watcher->on_reload(watcher->user, index, next.get(), prev ? &changes : 0);
+    }
+}
+
+// Mark the watched files called name (in dirs[dir]) as changed
+static void watch_touch(ini_watcher *watcher, int dir, const char *name, size_t length)
+{
+    for (ini_watch_file &file : watcher->files) {
+        const char *file_name = file.path.data() + file.name;
+        if (file.dir != dir || strlen(file_name) != length) {
+            continue;
+        }
+#ifdef _WIN32
+        bool match = !_strnicmp(file_name, name, length);
+#else
+        bool match = !memcmp(file_name, name, length);
+#endif
+        if (match) {
+            file.dirty = true;
+        }
+    }
+}
+
+static bool watch_any_dirty(const ini_watcher *watcher)
+{
+    for (const ini_watch_file &file : watcher->files) {
+        if (file.dirty) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void watch_reload_dirty(ini_watcher *watcher)
+{
+    for (int i = 0; i < (int)watcher->files.size(); i++) {
+        if (watcher->files[i].dirty) {
+            watch_reload(watcher, i);
+        }
+    }
+}
+
+#ifdef _WIN32
+// Start (or restart) the overlapped ReadDirectoryChangesW() for a directory
+static bool watch_dir_read(ini_watch_dir *dir)
+{
+    return ReadDirectoryChangesW(dir->handle, dir->changes, sizeof(dir->changes), FALSE,
+        FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE, 0,
+        &dir->overlapped, 0) != 0;
+}
+
+static void watch_thread(ini_watcher *watcher)
+{
+    // [0] is the stop event, then one per directory
+    std::vector<HANDLE> events;
+    events.push_back(watcher->stop);
+    for (ini_watch_dir &dir : watcher->dirs) {
+        events.push_back(dir.overlapped.hEvent);
+    }
+
+    for (;;) {
+        DWORD timeout = watch_any_dirty(watcher) ? (DWORD)watcher->debounce_ms : INFINITE;
+        DWORD wait = WaitForMultipleObjects((DWORD)events.size(), events.data(), FALSE, timeout);
+        if (wait == WAIT_TIMEOUT) {
+            // Quiet for a whole debounce period, the burst of writes is over
+            watch_reload_dirty(watcher);
+            continue;
+        }
+        if (wait == WAIT_OBJECT_0 || wait >= WAIT_OBJECT_0 + events.size()) {
+            break;
+        }
+
+        int d = (int)(wait - WAIT_OBJECT_0) - 1;
+        ini_watch_dir *dir = &watcher->dirs[d];
+        DWORD bytes = 0;
+        if (GetOverlappedResult(dir->handle, &dir->overlapped, &bytes, FALSE) && bytes) {
+            const char *record = (const char *)dir->changes;
+            for (;;) {
+                const FILE_NOTIFY_INFORMATION *info = (const FILE_NOTIFY_INFORMATION *)record;
+                char name[MAX_PATH];
+                int length = WideCharToMultiByte(CP_ACP, 0, info->FileName, (int)(info->FileNameLength / sizeof(WCHAR)),
+                    name, sizeof(name), 0, 0);
+                if (length > 0) {
+                    watch_touch(watcher, d, name, (size_t)length);
+                }
+                if (!info->NextEntryOffset) {
+                    break;
+                }
+                record += info->NextEntryOffset;
+            }
+        } else {
+            // Too many changes to fit in the buffer, we don't know which files it was
+            for (ini_watch_file &file : watcher->files) {
+                if (file.dir == d) {
+                    file.dirty = true;
+                }
+            }
+        }
+        watch_dir_read(dir);
+    }
+}
+#else
+static void watch_thread(ini_watcher *watcher)
+{
+    pollfd fds[2] = {};
+    fds[0].fd = watcher->wake[0];
+    fds[0].events = POLLIN;
+    fds[1].fd = watcher->notify_fd;
+    fds[1].events = POLLIN;
+    int nfds = watcher->notify_fd >= 0 ? 2 : 1;
+
+    for (;;) {
+        int timeout = -1;
+        if (watcher->notify_fd < 0) {
+            // Nothing to tell us about changes, check the mtimes every so often
+            timeout = 1000;
+        } else if (watch_any_dirty(watcher)) {
+            timeout = watcher->debounce_ms;
+        }
+        int ready = poll(fds, nfds, timeout);
+        if (ready < 0) {
+            continue;  // EINTR
+        }
+        if (fds[0].revents) {
+            break;
+        }
+        if (ready == 0) {
+            if (watcher->notify_fd < 0) {
+                for (ini_watch_file &file : watcher->files) {
+                    ini_cache_key key{};
+                    if (stat_file(file.path.data(), &key) == 0 && (key.size != file.key.size || key.mtime != file.key.mtime)) {
+                        file.dirty = true;
+                    }
+                }
+            }
+            // Quiet for a whole debounce period, the burst of writes is over
+            watch_reload_dirty(watcher);
+            continue;
+        }
+
+#ifdef __linux__
+        alignas(inotify_event) char events[4096];
+        ssize_t bytes;
+        while ((bytes = read(watcher->notify_fd, events, sizeof(events))) > 0) {
+            for (char *p = events; p < events + bytes; ) {
+                const inotify_event *event = (const inotify_event *)p;
+                if (event->mask & IN_Q_OVERFLOW) {
+                    // Lost events, we don't know which files it was
+                    for (ini_watch_file &file : watcher->files) {
+                        file.dirty = true;
+                    }
+                } else if (event->len) {
+                    for (int d = 0; d < (int)watcher->dirs.size(); d++) {
+                        if (watcher->dirs[d].wd == event->wd) {
+                            watch_touch(watcher, d, event->name, strlen(event->name));
+                        }
+                    }
+                }
+                p += sizeof(inotify_event) + event->len;
+            }
+        }
+#endif
+    }
+}
+#endif
+
+// Stop the watcher thread and release everything but the snapshots, which live on for as long as some
+// reader still holds them
+void stop_ini_watcher(ini_watcher *watcher)
+{
+    assert(watcher);
+
+#ifdef _WIN32
+    if (watcher->stop) {
+        SetEvent(watcher->stop);
+    }
+    if (watcher->thread.joinable()) {
+        watcher->thread.join();
+    }
+    for (ini_watch_dir &dir : watcher->dirs) {
+        if (dir.handle && dir.handle != INVALID_HANDLE_VALUE) {
+            CancelIoEx(dir.handle, &dir.overlapped);
+            CloseHandle(dir.handle);
+        }
+        if (dir.overlapped.hEvent) {
+            CloseHandle(dir.overlapped.hEvent);
+        }
+    }
+    if (watcher->stop) {
+        CloseHandle(watcher->stop);
+    }
+    watcher->stop = 0;
+#else
+    if (watcher->thread.joinable()) {
+        char byte = 0;
+        while (write(watcher->wake[1], &byte, 1) < 0) {}
+        watcher->thread.join();
+    }
+    if (watcher->notify_fd >= 0) {
+        close(watcher->notify_fd);  // closing it drops every watch too
+    }
+    if (watcher->wake[0] >= 0) {
+        close(watcher->wake[0]);
+        close(watcher->wake[1]);
+    }
+    watcher->notify_fd = -1;
+    watcher->wake[0] = watcher->wake[1] = -1;
+#endif
+    watcher->dirs.clear();
+    watcher->files.clear();
+}
+
+// Load every file in paths, then start a thread that reloads (with reload_ini()) and republishes each one
+// as it changes. Directories rather than files are watched, so editors that save by writing a new file and
+// renaming it over the old one are picked up too. A burst of writes only causes one reload, once the file
+// has been quiet for debounce_ms. Readers get the latest parse with ini_watch_snapshot().
+// Set the watcher's flags, quiet, on_reload and user first, they apply to every parse.
+// paths      : files to watch, a file that fails to load just has no snapshot until it's fixed
+// debounce_ms: how long a file has to be quiet before it's reloaded
+// Returns 0 on success, -1 if the directories can't be watched
+// WARN: you must stop_ini_watcher(watcher) when you're done with it!!
+int start_ini_watcher(ini_watcher *watcher, const char **paths, int count, int debounce_ms)
+{
+    assert(watcher);
+    assert(paths || !count);
+
+    watcher->debounce_ms = debounce_ms > 0 ? debounce_ms : 1;
+    watcher->dirs.clear();
+    watcher->files.clear();
+    for (int i = 0; i < count; i++) {
+        ini_watch_file file{};
+        file.path.assign(paths[i], paths[i] + strlen(paths[i]) + 1);
+
+        // Split into directory + name
+        std::vector<char> dir(file.path.begin(), file.path.end());
+        char *slash = strrchr(dir.data(), '/');
+#ifdef _WIN32
+        char *backslash = strrchr(dir.data(), '\\');
+        if (backslash > slash) {
+            slash = backslash;
+        }
+#endif
+        if (slash) {
+            file.name = (int)(slash - dir.data()) + 1;
+            slash[slash == dir.data() ? 1 : 0] = 0;  // keep the root's "/"
+        } else {
+            dir.assign({ '.', 0 });
+            file.name = 0;
+        }
+        dir.resize(strlen(dir.data()) + 1);
+
+        file.dir = -1;
+        for (int d = 0; d < (int)watcher->dirs.size(); d++) {
+            if (!strcmp(watcher->dirs[d].path.data(), dir.data())) {
+                file.dir = d;
+            }
+        }
+        if (file.dir < 0) {
+            file.dir = (int)watcher->dirs.size();
+            watcher->dirs.push_back(ini_watch_dir{});
+            watcher->dirs.back().path = dir;
+        }
+        watcher->files.push_back(file);
+    }
+
+    // Initial load, so readers have something to look at right away
+    for (int i = 0; i < (int)watcher->files.size(); i++) {
+        watch_reload(watcher, i);
+    }
+
+#ifdef _WIN32
+    watcher->stop = CreateEventA(0, TRUE, FALSE, 0);
+    for (ini_watch_dir &dir : watcher->dirs) {
+        dir.handle = CreateFileA(dir.path.data(), FILE_LIST_DIRECTORY,
+            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0, OPEN_EXISTING,
+            FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, 0);
+        dir.overlapped.hEvent = CreateEventA(0, TRUE, FALSE, 0);
+        if (dir.handle == INVALID_HANDLE_VALUE || !watch_dir_read(&dir)) {
+            fprintf(stderr, "Unable to watch %s\n", dir.path.data());
+            stop_ini_watcher(watcher);
+            return -1;
+        }
+    }
+#else
+    watcher->notify_fd = -1;
+    watcher->wake[0] = watcher->wake[1] = -1;
+    if (pipe(watcher->wake) < 0) {
+        fprintf(stderr, "Failed to create watcher pipe\n");
+        return -1;
+    }
+#ifdef __linux__
+    watcher->notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watcher->notify_fd < 0) {
+        fprintf(stderr, "Failed to create inotify instance\n");
+        stop_ini_watcher(watcher);
+        return -1;
+    }
+    for (ini_watch_dir &dir : watcher->dirs) {
+        dir.wd = inotify_add_watch(watcher->notify_fd, dir.path.data(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY | IN_DELETE);
+        if (dir.wd < 0) {
+            fprintf(stderr, "Unable to watch %s\n", dir.path.data());
+            stop_ini_watcher(watcher);
+            return -1;
+        }
+    }
+#endif
+#endif
+
+    watcher->thread = std::thread(watch_thread, watcher);
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Batch
+//------------------------------------------------------------------------------
+
+// read_entire_file() into an arena instead of the heap, without printing anything
+static int read_file_to_arena(const char *filename, ini_arena *arena, buffer *buf)
+{
+    *buf = buffer{};
+
+    FILE *fs = fopen(filename, "rb");
+    if (!fs) {
+        return -1;
+    }
+    fseek(fs, 0, SEEK_END);
+    long tell = ftell(fs);
+    if (tell < 0 || tell > INT_MAX) {
+        fclose(fs);
+        return -2;
+    }
+    rewind(fs);
+
+    size_t buflen = (size_t)tell;
+    char *data = (char *)arena_alloc(arena, buflen + 1, 1);
+    if (!data) {
+        fclose(fs);
+        return -3;
+    }
+    size_t read = fread(data, 1, buflen, fs);
+    fclose(fs);
+    if (read != buflen) {
+        return -4;
+    }
+    data[buflen] = 0;
+
+    buf->data = data;
+    buf->length = (int)buflen;
+    return 0;
+}
+
+// Read and parse count files on a pool of worker threads. Each worker starts on its own contiguous range of
+// paths and steals from the other workers' ranges once it runs out, so a few huge files don't leave the
+// rest of the pool idle. While one worker waits on a read, the others keep parsing. Errors are per file,
+// a file that can't be read or parsed doesn't stop the rest of the batch.
+// results     : count results, results[i] is for paths[i]
+// batch       : owns the file buffers and parser tables, they're allocated from per-worker arenas
+// flags       : ini_parser::flags for every parse
+// thread_count: max # of worker threads, 0 = one per hardware thread
+// Returns # of files that couldn't be read or parsed
+// WARN: results are only valid until free_ini_batch(batch)!! Results parsed by the same worker share an
+//       arena, so set INI_BUILD_LOOKUP if threads will ini_get() from different results at once
+int ini_parse_batch(const char **paths, int count, ini_batch_result *results, ini_batch *batch, int flags,
+    int thread_count)
+{
+    INI_TRACE_SCOPE("ini_parse_batch");
+    assert(paths || !count);
+    assert(results || !count);
+    assert(batch);
+
+    if (thread_count <= 0) {
+        thread_count = (int)std::thread::hardware_concurrency();
+    }
+    if (thread_count > count) {
+        thread_count = count;
+    }
+    if (thread_count < 1) {
+        thread_count = 1;
+    }
+
+    // Worker w owns paths [w * count / threads, (w + 1) * count / threads), next[w] is the next one to take
+    std::vector<ini_arena *> arenas(thread_count);
+    for (ini_arena *&arena : arenas) {
+        arena = new ini_arena;
+        init_arena(arena);
+    }
+    std::unique_ptr<std::atomic<int>[]> next(new std::atomic<int>[thread_count]);
+    std::vector<int> ends(thread_count);
+    for (int w = 0; w < thread_count; w++) {
+        next[w] = (int)((long long)count * w / thread_count);
+        ends[w] = (int)((long long)count * (w + 1) / thread_count);
+    }
+    std::atomic<int> failed(0);
+
+    auto process = [&](int i, ini_arena *arena) {
+        ini_batch_result *result = &results[i];
+        *result = ini_batch_result{};
+        INI_STAT(int64_t io_start = stats_now());
+        result->read_error = read_file_to_arena(paths[i], arena, &result->buf);
+        INI_STAT(int64_t io_ns = stats_now() - io_start);
+        if (result->read_error < 0) {
+            failed++;
+            return;
+        }
+        init_ini(&result->ini, result->buf, arena);
+        INI_STAT(result->ini.stats.io_ns = io_ns);
+        result->ini.writable = true;
+        result->ini.quiet = true;
+        result->ini.flags = flags;
+        result->parse_error = parse_ini(&result->ini);
+        if (result->parse_error < 0) {
+            failed++;
+        }
+    };
+    auto worker = [&](int w) {
+        // Own range first, then steal from everyone else's in turn
+        for (int k = 0; k < thread_count; k++) {
+            int victim = (w + k) % thread_count;
+            for (;;) {
+                int i = next[victim]++;
+                if (i >= ends[victim]) {
+                    break;
+                }
+                process(i, arenas[w]);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count - 1);
+    for (int w = 1; w < thread_count; w++) {
+        threads.emplace_back(worker, w);
+    }
+    worker(0);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    batch->arenas.insert(batch->arenas.end(), arenas.begin(), arenas.end());
+    return failed;
+}
+
+// Release every result of every ini_parse_batch() that used this batch
+void free_ini_batch(ini_batch *batch)
+{
+    assert(batch);
+
+    for (ini_arena *arena : batch->arenas) {
+        free_arena(arena);
+        delete arena;
+    }
+    batch->arenas.clear();
+}
+
+//------------------------------------------------------------------------------
+// Async loading
+//------------------------------------------------------------------------------
+
+// One file of the window ini_load_async() has in flight
+struct async_file {
+#ifdef _WIN32
+    HANDLE handle;
+    OVERLAPPED overlapped;          // read in flight, completions come back through the port
+#else
+    int fd;
+#endif
+    uint64_t size;                  // file size
+    uint64_t done;                  // bytes read so far
+    char *data;                     // size + 1 bytes in the batch arena
+#ifdef INI_IO_URING
+    struct statx stx;
+#endif
+};
+
+// Parse a file whose read just completed, results[i].read_error must already be set
+static void async_parse(ini_batch_result *result, async_file *file, ini_arena *arena, int flags, int *failed)
+{
+    if (result->read_error < 0) {
+        (*failed)++;
+        return;
+    }
+    file->data[file->done] = 0;
+    result->buf = buffer{ file->data, (int)file->done };
+    init_ini(&result->ini, result->buf, arena);
+    result->ini.writable = true;
+    result->ini.quiet = true;
+    result->ini.flags = flags;
+    result->parse_error = parse_ini(&result->ini);
+    if (result->parse_error < 0) {
+        (*failed)++;
+    }
+}
+
+#ifdef INI_IO_URING
+// Minimal io_uring over the raw syscalls, just enough for ini_load_async()
+struct ini_uring {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    io_uring_sqe *sqes;
+    io_uring_cqe *cqes;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+    unsigned queued;                // SQEs written but not submitted yet
+};
+
+static void uring_free(ini_uring *ring)
+{
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+    if (ring->sq_ring) munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->fd >= 0) close(ring->fd);
+    *ring = ini_uring{};
+    ring->fd = -1;
+}
+
+// Returns 0 on success, -1 if io_uring (or one of the ops we need) isn't available
+static int uring_init(ini_uring *ring, unsigned entries)
+{
+    *ring = ini_uring{};
+    io_uring_params params{};
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+        return -1;
+    }
+
+    // Needs openat/statx/read (5.6+), older kernels take the blocking path
+    size_t probe_size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+    std::vector<char> probe_buf(probe_size, 0);
+    io_uring_probe *probe = (io_uring_probe *)probe_buf.data();
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+        close(ring->fd);
+        return -1;
+    }
+    for (int op : { IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_READ_FIXED }) {
+        if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+            close(ring->fd);
+            return -1;
+        }
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+    ring->sq_ring = mmap(0, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        ring->sq_ring = 0;
+        uring_free(ring);
+        return -1;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(0, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            ring->cq_ring = 0;
+            uring_free(ring);
+            return -1;
+        }
+    }
+    ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    ring->sqes = (io_uring_sqe *)mmap(0, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = 0;
+        uring_free(ring);
+        return -1;
+    }
+
+    char *sq = (char *)ring->sq_ring;
+    char *cq = (char *)ring->cq_ring;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (io_uring_cqe *)(cq + params.cq_off.cqes);
+    return 0;
+}
+
+// Next free SQE, zeroed. The caller never queues more than the ring holds.
+static io_uring_sqe *uring_sqe(ini_uring *ring, uint8_t opcode, uint64_t user_data)
+{
+    unsigned tail = *ring->sq_tail + ring->queued;
+    unsigned index = tail & *ring->sq_mask;
+    io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->user_data = user_data;
+    ring->sq_array[index] = index;
+    ring->queued++;
+    return sqe;
+}
+
+// Submit everything queued and wait until at least one completion is ready
+static int uring_submit_wait(ini_uring *ring)
+{
+    unsigned submit = ring->queued;
+    if (submit) {
+        __atomic_store_n(ring->sq_tail, *ring->sq_tail + submit, __ATOMIC_RELEASE);
+        ring->queued = 0;
+    }
+    for (;;) {
+        long ret = syscall(__NR_io_uring_enter, ring->fd, submit, 1, IORING_ENTER_GETEVENTS, 0, 0);
+        if (ret >= 0 || errno != EINTR) {
+            return ret < 0 ? -1 : 0;
+        }
+        submit = 0;
+    }
+}
+
+// Pop a completion if there is one
+static bool uring_cqe(ini_uring *ring, io_uring_cqe *out)
+{
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    *out = ring->cqes[head & *ring->cq_mask];
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// What a completion was for, packed into user_data next to the file's index in the window
+#define ASYNC_OPEN  0
+#define ASYNC_STAT  1
+#define ASYNC_READ  2
+
+static void uring_read(ini_uring *ring, async_file *file, int index, bool fixed)
+{
+    io_uring_sqe *sqe = uring_sqe(ring, fixed ? IORING_OP_READ_FIXED : IORING_OP_READ, ((uint64_t)index << 2) | ASYNC_READ);
+    sqe->fd = file->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(file->data + file->done);
+    sqe->len = (unsigned)(file->size - file->done);
+    sqe->off = file->done;
+    sqe->buf_index = 0;
+}
+
+static int load_uring(ini_uring *ring, const char **paths, int count, ini_batch_result *results, ini_arena *arena,
+    int flags, int depth)
+{
+    int failed = 0;
+    std::vector<async_file> files(depth);
+
+    for (int base = 0; base < count; base += depth) {
+        int n = count - base < depth ? count - base : depth;
+
+        // Open and stat the whole window in one go
+        for (int i = 0; i < n; i++) {
+            results[base + i] = ini_batch_result{};
+            files[i] = async_file{};
+            files[i].fd = -1;
+            io_uring_sqe *sqe = uring_sqe(ring, IORING_OP_OPENAT, ((uint64_t)i << 2) | ASYNC_OPEN);
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uint64_t)(uintptr_t)paths[base + i];
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+            sqe = uring_sqe(ring, IORING_OP_STATX, ((uint64_t)i << 2) | ASYNC_STAT);
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uint64_t)(uintptr_t)paths[base + i];
+            sqe->len = STATX_SIZE;
+            sqe->off = (uint64_t)(uintptr_t)&files[i].stx;
+        }
+        for (int pending = 2 * n; pending > 0; ) {
+            if (uring_submit_wait(ring) < 0) {
+                return -1;
+            }
+            io_uring_cqe cqe;
+            while (uring_cqe(ring, &cqe)) {
+                int i = (int)(cqe.user_data >> 2);
+                ini_batch_result *result = &results[base + i];
+                if ((cqe.user_data & 3) == ASYNC_OPEN) {
+                    if (cqe.res < 0) {
+                        result->read_error = -1;
+                    } else {
+                        files[i].fd = cqe.res;
+                    }
+                } else if (cqe.res < 0 || files[i].stx.stx_size > INT_MAX) {
+                    if (!result->read_error) {
+                        result->read_error = -2;
+                    }
+                } else {
+                    files[i].size = files[i].stx.stx_size;
+                }
+                pending--;
+            }
+        }
+
+        // One buffer for the whole window, registered with the ring if the memlock limit allows so the
+        // kernel doesn't have to pin pages for every read
+        size_t total = 0;
+        for (int i = 0; i < n; i++) {
+            if (!results[base + i].read_error) {
+                total += files[i].size + 1;
+            }
+        }
+        char *window = total ? (char *)arena_alloc(arena, total, 64) : 0;
+        bool fixed = false;
+        if (window) {
+            iovec iov{ window, total };
+            fixed = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, &iov, 1) == 0;
+        }
+
+        // Read everything, parsing each file as soon as its read completes while the rest are in flight
+        int in_flight = 0;
+        size_t offset = 0;
+        for (int i = 0; i < n; i++) {
+            ini_batch_result *result = &results[base + i];
+            if (!result->read_error && !window) {
+                result->read_error = -3;
+            }
+            if (result->read_error) {
+                if (files[i].fd >= 0) {
+                    close(files[i].fd);
+                }
+                failed++;
+                continue;
+            }
+            files[i].data = window + offset;
+            offset += files[i].size + 1;
+            if (!files[i].size) {
+                close(files[i].fd);
+                async_parse(result, &files[i], arena, flags, &failed);
+                continue;
+            }
+            uring_read(ring, &files[i], i, fixed);
+            in_flight++;
+        }
+        while (in_flight > 0) {
+            if (uring_submit_wait(ring) < 0) {
+                return -1;
+            }
+            io_uring_cqe cqe;
+            while (uring_cqe(ring, &cqe)) {
+                int i = (int)(cqe.user_data >> 2);
+                async_file *file = &files[i];
+                if (cqe.res > 0) {
+                    file->done += (uint64_t)cqe.res;
+                    if (file->done < file->size) {
+                        // Short read (or a signal), go again for the rest
+                        uring_read(ring, file, i, fixed);
+                        continue;
+                    }
+                } else if (cqe.res < 0) {
+                    results[base + i].read_error = -4;
+                }
+                // res == 0: file shrank since the statx, take what's there
+                close(file->fd);
+                in_flight--;
+                async_parse(&results[base + i], file, arena, flags, &failed);
+            }
+        }
+
+        if (fixed) {
+            syscall(__NR_io_uring_register, ring->fd, IORING_UNREGISTER_BUFFERS, 0, 0);
+        }
+    }
+    return failed;
+}
+#endif
+
+#ifdef _WIN32
+static int load_overlapped(HANDLE port, const char **paths, int count, ini_batch_result *results, ini_arena *arena,
+    int flags, int depth)
+{
+    int failed = 0;
+    std::vector<async_file> files(depth);
+
+    auto read = [&](int i) {
+        async_file *file = &files[i];
+        memset(&file->overlapped, 0, sizeof(file->overlapped));
+        file->overlapped.Offset = (DWORD)file->done;
+        file->overlapped.OffsetHigh = (DWORD)(file->done >> 32);
+        DWORD want = (DWORD)(file->size - file->done);
+        if (!ReadFile(file->handle, file->data + file->done, want, 0, &file->overlapped) &&
+            GetLastError() != ERROR_IO_PENDING) {
+            return false;
+        }
+        return true;
+    };
+
+    for (int base = 0; base < count; base += depth) {
+        int n = count - base < depth ? count - base : depth;
+
+        // Windows can't open files asynchronously, but at least every read of the window is in flight at once
+        int in_flight = 0;
+        for (int i = 0; i < n; i++) {
+            ini_batch_result *result = &results[base + i];
+            async_file *file = &files[i];
+            *result = ini_batch_result{};
+            *file = async_file{};
+            file->handle = CreateFileA(paths[base + i], GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+                FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN, 0);
+            if (file->handle == INVALID_HANDLE_VALUE) {
+                result->read_error = -1;
+                failed++;
+                continue;
+            }
+            LARGE_INTEGER size{};
+            if (!GetFileSizeEx(file->handle, &size) || size.QuadPart > INT_MAX) {
+                result->read_error = -2;
+            } else if (!(file->data = (char *)arena_alloc(arena, (size_t)size.QuadPart + 1, 1))) {
+                result->read_error = -3;
+            } else if (!CreateIoCompletionPort(file->handle, port, (ULONG_PTR)i, 0)) {
+                result->read_error = -4;
+            }
+            file->size = (uint64_t)size.QuadPart;
+            if (result->read_error) {
+                CloseHandle(file->handle);
+                failed++;
+                continue;
+            }
+            if (!file->size) {
+                CloseHandle(file->handle);
+                async_parse(result, file, arena, flags, &failed);
+                continue;
+            }
+            if (!read(i)) {
+                result->read_error = -4;
+                CloseHandle(file->handle);
+                failed++;
+                continue;
+            }
+            in_flight++;
+        }
+
+        // Parse each file as soon as its read completes while the rest are in flight
+        while (in_flight > 0) {
+            DWORD bytes = 0;
+            ULONG_PTR key = 0;
+            OVERLAPPED *overlapped = 0;
+            BOOL ok = GetQueuedCompletionStatus(port, &bytes, &key, &overlapped, INFINITE);
+            if (!overlapped) {
+                return -1;
+            }
+            int i = (int)key;
+            async_file *file = &files[i];
+            if (ok && bytes) {
+                file->done += bytes;
+                if (file->done < file->size) {
+                    if (read(i)) {
+                        continue;
+                    }
+                    results[base + i].read_error = -4;
+                }
+            } else if (!ok && GetLastError() != ERROR_HANDLE_EOF) {
+                results[base + i].read_error = -4;
+            }
+            CloseHandle(file->handle);
+            in_flight--;
+            async_parse(&results[base + i], file, arena, flags, &failed);
+        }
+    }
+    return failed;
+}
+#endif
+
+// ini_parse_batch() without the blocking reads: every file of a window of depth files is read at once
+// (io_uring on Linux, overlapped ReadFile() on Windows) and parsed with parse_ini() the moment its read
+// completes, so loading lots of files costs a few syscalls per window instead of several per file.
+// All on the calling thread. Where async I/O isn't available (old kernel, other OS) this just calls
+// ini_parse_batch().
+// results: count results, results[i] is for paths[i]
+// batch  : owns the file buffers and parser tables
+// flags  : ini_parser::flags for every parse
+// depth  : max # of files in flight at once (also bounds the # of open file descriptors)
+// Returns # of files that couldn't be read or parsed
+// WARN: results are only valid until free_ini_batch(batch)!!
+int ini_load_async(const char **paths, int count, ini_batch_result *results, ini_batch *batch, int flags,
+    int depth)
+{
+    INI_TRACE_SCOPE("ini_load_async");
+    assert(paths || !count);
+    assert(results || !count);
+    assert(batch);
+
+    if (depth < 1) {
+        depth = 1;
+    }
+    if (depth > count) {
+        depth = count > 0 ? count : 1;
+    }
+
+#ifdef INI_IO_URING
+    ini_uring ring;
+    if (uring_init(&ring, (unsigned)(2 * depth)) == 0) {
+        ini_arena *arena = new ini_arena;
+        init_arena(arena);
+        batch->arenas.push_back(arena);
+        int failed = load_uring(&ring, paths, count, results, arena, flags, depth);
+        uring_free(&ring);
+        if (failed >= 0) {
+            return failed;
+        }
+    }
+#elif defined(_WIN32)
+    HANDLE port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, 0, 0, 1);
+    if (port) {
+        ini_arena *arena = new ini_arena;
+        init_arena(arena);
+        batch->arenas.push_back(arena);
+        int failed = load_overlapped(port, paths, count, results, arena, flags, depth);
+        CloseHandle(port);
+        if (failed >= 0) {
+            return failed;
+        }
+    }
+#endif
+
+    return ini_parse_batch(paths, count, results, batch, flags);
+}
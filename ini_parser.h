@@ -0,0 +1,877 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+struct buffer {
+    char *data;
+    int length;
+};
+
+// slice is essentialy same thing, but doesn't own the memory, just points into a buffer
+typedef buffer slice;
+
+// read-only view of a file mapped into memory, see map_entire_file()
+struct mapped_file {
+    buffer buf;                     // file contents (NOT nil-terminated!)
+#ifdef _WIN32
+    HANDLE file;                    // handle of the mapped file
+    HANDLE mapping;                 // file mapping object backing buf
+#endif
+};
+
+// Chunked bump allocator. Individual allocations are never freed, the whole arena goes at once with
+// reset_arena()/free_arena(), so a parse backed by an arena tears down in a single free.
+// Blocks come from alloc/free if set (e.g. a caller's own chunk allocator), malloc/free otherwise.
+struct ini_arena_block {
+    ini_arena_block *next;
+    size_t size;                    // usable bytes after this header
+    size_t used;
+};
+
+struct ini_arena {
+    ini_arena_block *blocks;        // current block first
+    size_t block_size;              // minimum size of each block, bigger allocations get their own block
+    void *(*alloc)(size_t size, void *user);
+    void (*free)(void *block, void *user);
+    void *user;                     // passed through to alloc/free
+};
+
+// Default ini_arena::block_size
+#define INI_ARENA_BLOCK_SIZE (64 * 1024)
+
+void init_arena(ini_arena *arena, size_t block_size = INI_ARENA_BLOCK_SIZE);
+void *arena_alloc(ini_arena *arena, size_t size, size_t align);
+void reset_arena(ini_arena *arena);
+void free_arena(ini_arena *arena);
+
+#ifdef INI_STATS
+// Bytes held by every ini_allocator on this thread right now, and the most they've held, see
+// ini_parse_stats::peak_bytes
+extern thread_local size_t ini_held_bytes;
+extern thread_local size_t ini_peak_bytes;
+#endif
+
+// STL allocator that carves memory out of an ini_arena, or uses the heap if arena is nil
+template <typename T>
+struct ini_allocator {
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    ini_arena *arena;
+
+    ini_allocator() : arena(0) {}
+    explicit ini_allocator(ini_arena *arena) : arena(arena) {}
+    template <typename U> ini_allocator(const ini_allocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t n) {
+        void *p = arena ? arena_alloc(arena, n * sizeof(T), alignof(T)) : malloc(n * sizeof(T));
+        if (!p) {
+            throw std::bad_alloc();
+        }
+#ifdef INI_STATS
+        ini_held_bytes += n * sizeof(T);
+        if (ini_held_bytes > ini_peak_bytes) {
+            ini_peak_bytes = ini_held_bytes;
+        }
+#endif
+        return (T *)p;
+    }
+    void deallocate(T *p, size_t n) {
+#ifdef INI_STATS
+        ini_held_bytes -= n * sizeof(T);
+#else
+        (void)n;
+#endif
+        // arena memory is released all at once by the arena's owner
+        if (!arena) {
+            free(p);
+        }
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const ini_allocator<T> &a, const ini_allocator<U> &b) { return a.arena == b.arena; }
+template <typename T, typename U>
+bool operator!=(const ini_allocator<T> &a, const ini_allocator<U> &b) { return a.arena != b.arena; }
+
+// Every growable table owned by the parser uses this, so it all lands in the parser's arena (if any)
+template <typename T>
+using ini_vector = std::vector<T, ini_allocator<T>>;
+
+// Byte counts gathered by ini_scanner::count
+struct ini_byte_counts {
+    int lf;                         // # of '\n'
+    int cr;                         // # of '\r'
+    int eq;                         // # of '='
+};
+
+// Byte scanning backend used by the parser's inner loops. Every backend finds exactly the same bytes,
+// the vectorized ones just look at 16-32 bytes per step. Each function returns a pointer to the first
+// matching byte in [p, end), or end if there isn't one.
+struct ini_scanner {
+    const char *name;
+    const char *(*find_eol)(const char *p, const char *end);            // '\r' or '\n'
+    const char *(*find_eq_eol)(const char *p, const char *end);         // '=', '\r' or '\n'
+    const char *(*find_char)(const char *p, const char *end, char c);   // c
+    // Bit i is set if p[i] is a structural character ('\n', '\r', '=', ';', '[' or ']'), reads 64 bytes
+    uint64_t (*classify64)(const char *p);
+    // Adds the # of '\n', '\r' and '=' in [p, end) to counts
+    void (*count)(const char *p, const char *end, ini_byte_counts *counts);
+    // First byte of the first invalid UTF-8 sequence in [p, end) (a sequence cut off by end is invalid too)
+    const char *(*validate_utf8)(const char *p, const char *end);
+};
+
+// Offsets of every structural character in a buffer, built by index_ini() so the buffer is only scanned
+// once and the second pass (and anything else that wants to walk lines) can hop between them
+struct ini_index {
+    ini_vector<int> offsets;        // ascending, followed by buf.length as a sentinel
+};
+
+// parse_ini() return code when ini_parser::partial is set and buf ends in the middle of a statement. The
+// cursor is left on the start of that statement, so it can be parsed again once more input is available.
+#define INI_NEED_MORE 1
+
+// parse_ini_parallel() won't split the buffer into chunks smaller than this
+#define INI_PARALLEL_MIN_CHUNK (256 * 1024)
+
+struct ini_kv {
+    slice section;
+    slice key;
+    slice value;
+    int flags;                      // INI_VALUE_*, how value was read (0 = straight from buf, untouched)
+};
+
+// ini_kv::flags, only ever set with INI_QUOTED_VALUES
+#define INI_VALUE_QUOTED     0x1    // value was in "quotes", value is what's between them
+#define INI_VALUE_IN_PLACE   0x2    // value had escapes, it was unescaped in place (still points into buf)
+#define INI_VALUE_SPILLED    0x4    // value had escapes, buf isn't writable so it was unescaped into an arena
+
+// parse_ini() return code when an ini_visitor callback asked to stop. The cursor is left just past the
+// statement the callback stopped on, so calling parse_ini() again picks up from there.
+#define INI_STOPPED 2
+
+// internal: return code of parse_section_header()/parse_kv() when INI_RECOVER recorded an error, the parse
+// loop skips the rest of the line and carries on
+#define INI_SKIPPED 3
+
+// ini_error::code, what was wrong with the line
+#define INI_ERROR_SECTION_EOF   1   // [section without a ']'
+#define INI_ERROR_KEY_EOF       2   // key without an '=', at the end of the file
+#define INI_ERROR_KEY_EOL       3   // key without an '=' before the end of its line
+#define INI_ERROR_NO_KEY        4   // nothing before the '='
+#define INI_ERROR_NO_VALUE      5   // nothing after the '='
+#define INI_ERROR_QUOTE_EOL     6   // INI_QUOTED_VALUES: no closing '"' before the end of the line
+#define INI_ERROR_AFTER_QUOTE   7   // INI_QUOTED_VALUES: something other than a ; comment after the closing '"'
+#define INI_ERROR_ESCAPE        8   // INI_QUOTED_VALUES: unknown \ escape
+#define INI_ERROR_TYPE          9   // ini_parse_schema(): value doesn't convert to its field's type
+#define INI_ERROR_UTF8          10  // INI_VALIDATE_UTF8: invalid UTF-8 sequence (column is where it starts)
+
+// A parse error, with enough context to point at it without re-reading the file
+struct ini_error {
+    int code;                       // INI_ERROR_*, 0 = no error
+    const char *msg;                // description, a string literal
+    int line;                       // 1-based line #
+    int column;                     // 1-based byte column within the line
+    int offset;                     // byte offset into buf
+    slice text;                     // the whole offending line, without its newline (points into buf, or into
+                                    // ini_stream::strings)
+};
+
+// Callbacks parse_ini() hands results to as it finds them (event/SAX style). If kv or section is set,
+// nothing is stored in the parser at all, the callbacks get slices straight into buf. Returning non-zero
+// from kv or section stops the parse (parse_ini() returns INI_STOPPED), e.g. once the section you were
+// after has ended.
+struct ini_visitor {
+    int (*section)(void *user, slice name);                 // entering a [section]
+    int (*kv)(void *user, const ini_kv *kv);                // key=value in the current section
+    void (*error)(void *user, int line, const char *msg);   // parse error, replaces the stderr message (the
+                                                            // details are in ini_parser::error as well)
+    void *user;                                             // passed through to every callback
+};
+
+// One slot of an open-addressing hash table, index is -1 for empty slots
+struct ini_slot {
+    uint32_t hash;
+    int index;
+};
+
+// Hash table over section+key -> index into ini_parser::properties (linear probing, power of 2 size)
+struct ini_table {
+    ini_vector<ini_slot> slots;
+    int count;                      // # of occupied slots
+    int indexed;                    // # of properties inserted so far, the rest get inserted on next lookup
+};
+
+// Interned [section] name, see INI_LAYOUT_SECTIONS
+struct ini_section {
+    slice name;
+    int begin;                      // [begin, end) range of this section's properties in section_properties,
+    int end;                        // -1 if it doesn't have any (yet)
+};
+
+// Property in the section-grouped layout, the section is an index into ini_parser::sections instead of a copy
+struct ini_section_kv {
+    uint32_t section;
+    slice key;
+    slice value;
+};
+
+// Properties as parallel arrays of 32-bit offsets/lengths relative to ini_parser::buf.data, 20 bytes per
+// property instead of sizeof(ini_kv). Use the ini_compact_*() accessors to turn them back into slices.
+struct ini_compact {
+    ini_vector<uint32_t> section;   // index into ini_parser::sections
+    ini_vector<uint32_t> key_offset;
+    ini_vector<uint32_t> key_length;
+    ini_vector<uint32_t> value_offset;
+    ini_vector<uint32_t> value_length;
+};
+
+// [section] header found by index_ini_sections(), its body is only parsed once someone asks for it
+struct ini_lazy_section {
+    slice name;
+    int body_begin;                 // [body_begin, body_end) is everything between this header's ']' and
+    int body_end;                   // the next header's '['
+    int line;                       // line # body_begin is on
+    int next;                       // index of the next header with the same name, -1 if there isn't one
+    bool loaded;                    // body has been parsed into ini_parser::properties
+};
+
+// Section offset index for the lazy parse, see index_ini_sections()
+struct ini_lazy {
+    ini_vector<ini_lazy_section> sections;  // every header in file order, [0] is the unnamed section
+    ini_table table;                        // section name -> index of the first header with that name
+};
+
+// Converted value of a property, cached by the typed getters when INI_CACHE_TYPED is set
+struct ini_typed {
+    int type;                       // INI_TYPE_* the value was converted to, 0 if it hasn't been yet
+    union {
+        int64_t i;                  // INI_TYPE_INT, INI_TYPE_DURATION (nanoseconds)
+        uint64_t u;                 // INI_TYPE_SIZE (bytes)
+        double d;                   // INI_TYPE_DOUBLE
+        bool b;                     // INI_TYPE_BOOL
+    };
+};
+
+// ini_typed::type
+#define INI_TYPE_INT       1
+#define INI_TYPE_DOUBLE    2
+#define INI_TYPE_BOOL      3
+#define INI_TYPE_DURATION  4
+#define INI_TYPE_SIZE      5
+#define INI_TYPE_STRING    6        // raw value slice, only used by schemas
+
+// ini_parser::flags
+#define INI_BUILD_LOOKUP     0x1    // insert each property into the lookup table as it's parsed
+#define INI_LAYOUT_SECTIONS  0x2    // intern sections into ini_parser::sections and group properties by section
+                                    // into ini_parser::section_properties
+#define INI_NO_PROPERTIES    0x4    // don't fill ini_parser::properties (or the lookup table), only the other layouts
+#define INI_LAYOUT_COMPACT   0x10   // store properties in file order in ini_parser::compact (interns sections too)
+#define INI_CACHE_TYPED      0x20   // ini_get_int() and friends remember each property's converted value
+#define INI_QUOTED_VALUES    0x40   // values can be "quoted" (with \\ \" \' \n \r \t \0 escapes) and followed by a
+                                    // ; comment, see parse_value(). INI_LAYOUT_COMPACT also needs writable then.
+#define INI_RECOVER          0x80   // skip lines with errors instead of stopping at the first one, every error is
+                                    // collected in ini_parser::errors (and never printed). parse_ini() still
+                                    // returns -1 at the end if it ran into any.
+#define INI_VALIDATE_UTF8    0x100  // check buf is valid UTF-8 before parsing it, see check_utf8(). With INI_RECOVER
+                                    // each line with invalid bytes is reported, but still parsed.
+#define INI_RECORD_HEADERS   0x8    // internal: the parallel parser's workers record each [header] in properties as
+                                    // a property with a nil key, so the merge can replay them in order
+
+// What went into everything parsed into a parser since init_ini(). Only filled in if the library is built
+// with INI_STATS defined, otherwise it stays zeroed and none of the counting is compiled in.
+struct ini_parse_stats {
+    int64_t bytes;                  // bytes of buf parsed
+    int lines;                      // lines parsed
+    int sections;                   // [section]s entered
+    int properties;                 // properties stored (or handed to the visitor)
+    int estimated_properties;       // ini_parser::estimated_properties, to compare with properties
+    int64_t comment_bytes;          // bytes of ; comments, including the ';'
+    int reallocations;              // times properties had to grow
+    int64_t io_ns;                  // reading the file, if a loader filled the parser (load_ini_cached(), ini_parse_batch())
+    int64_t tokenize_ns;            // parsing, not counting emit_ns
+    int64_t emit_ns;                // storing properties and sections (layouts, lookup table, visitor callbacks)
+    size_t peak_bytes;              // most the parser's tables held at once during a parse, allocated on the
+                                    // parsing thread (parse_ini_parallel()'s workers aren't counted)
+    int depth;                      // internal: parses running inside another one aren't counted twice
+};
+
+// Called around every parse and file load, e.g. to attribute config load time in a tracing system. span
+// is the name of the function (e.g. "parse_ini"), spans nest. Only called if the library is built with
+// INI_STATS defined, see ini_set_trace().
+struct ini_trace {
+    void (*begin)(void *user, const char *span);
+    void (*end)(void *user, const char *span);
+    void *user;
+};
+
+struct ini_parser {
+    buffer buf;                     // file buffer
+    int cursor;                     // current offset in buffer where parser is
+    int line;                       // current line # being parsed (for nice errors)
+    slice section;                  // current [section] we're in (if any)
+    ini_vector<ini_kv> properties;  // key-value properties read in so far
+    const ini_scanner *scan;        // byte scanning backend, init_ini() picks the fastest one the CPU supports
+    ini_index index;                // structural index, only filled in by index_ini()
+    bool quiet;                     // don't print parse errors to stderr (e.g. worker parsers of a parallel parse),
+                                    // they're still recorded in error
+    bool partial;                   // more input follows buf, parse_ini() stops with INI_NEED_MORE instead of
+                                    // reporting EOF errors (used by ini_stream)
+    bool writable;                  // buf may be modified (e.g. it came from read_entire_file()), so
+                                    // INI_QUOTED_VALUES unescapes values in place instead of copying them
+    int flags;                      // INI_* options, set these before parsing (init_ini() keeps them)
+    ini_visitor visitor;            // if set, results go to these callbacks instead of being stored
+    ini_error error;                // first parse error since init_ini(), code 0 if there hasn't been one
+    ini_vector<ini_error> errors;   // INI_RECOVER: every parse error, in the order they were found
+    ini_table lookup;               // section+key hash table used by ini_find()/ini_get()
+    ini_vector<int> sorted;         // effective properties ordered by section, then key (indices into properties),
+                                    // built by the first range query, see update_ini_sorted()
+    int sorted_count;               // # of properties sorted covers
+    ini_arena *arena;               // backs properties and every side table, nil = heap
+    ini_arena strings;              // values INI_QUOTED_VALUES had to copy while arena was nil (or that
+                                    // parse_ini_parallel()'s workers copied), free_arena() it when you're done
+    int estimated_properties;       // upper bound on # of properties, counted by init_ini() to pre-size properties
+    int utf8_checked;               // INI_VALIDATE_UTF8: buf has been validated up to this offset
+
+    // INI_LAYOUT_SECTIONS
+    ini_vector<ini_section> sections;                 // unique sections in order of first appearance, [0] is unnamed
+    ini_vector<ini_section_kv> section_properties;    // properties grouped by section, file order within a section
+    ini_table section_table;                          // section name -> index into sections
+    uint32_t section_index;                           // index of the current section
+    bool sections_grouped;                            // false if a section's range needs fixing up
+
+    // INI_LAYOUT_COMPACT
+    ini_compact compact;
+
+    // INI_CACHE_TYPED
+    ini_vector<ini_typed> typed;    // parallel to properties, filled in as values get converted
+
+    // index_ini_sections()
+    ini_lazy lazy;
+
+    // INI_STATS
+    ini_parse_stats stats;
+};
+
+// Push-style parser for input that arrives in pieces (sockets, decompressors, ...). Feed it bytes with
+// ini_feed() as they come in and call ini_finish() at the end. Only the unfinished statement at the end of
+// each piece is buffered, so memory is bounded by the longest line rather than the whole file.
+// Completed properties are either handed to on_kv, or kept in ini.properties (and ini.sections etc. if
+// the matching INI_LAYOUT_* flags are set, INI_LAYOUT_COMPACT isn't supported). Kept properties point at
+// copies of their strings in the stream's own arena, since the fed buffers are gone by then.
+struct ini_stream {
+    ini_parser ini;                 // parse options and results, buf points at whatever is being parsed right now
+    ini_vector<char> pending;       // start of a statement that didn't fit in the last ini_feed()
+    ini_arena strings;              // copies of every key/value/section name that outlives its ini_feed()
+    slice section_src;              // last section name copied, and its copy, so properties of the same
+    slice section_copy;             // section share one copy
+    void (*on_kv)(void *user, const ini_kv *kv);  // if set, properties are passed here instead of being kept,
+                                                  // their slices are only valid during the call
+    void *user;                     // passed through to on_kv
+    bool started;                   // past the byte order mark, if the input starts with one
+    int column;                     // bytes of the current line consumed by earlier pieces (or the byte order
+                                    // mark), error columns count them like parse_ini()'s do
+};
+
+// ini_load_compressed() decompresses this many bytes at a time
+#define INI_DECOMPRESS_BLOCK (256 * 1024)
+
+// One effective property that differs between two parses, see reload_ini()
+struct ini_change {
+    int kind;                       // INI_ADDED, INI_REMOVED or INI_MODIFIED
+    slice section;                  // points into the new buffer, or the old one for INI_REMOVED
+    slice key;
+    slice old_value;                // nil for INI_ADDED
+    slice new_value;                // nil for INI_REMOVED
+};
+
+// ini_change::kind
+#define INI_ADDED     1
+#define INI_REMOVED   2
+#define INI_MODIFIED  3
+
+// Effective property of an overlay: the value ini_get() on the topmost layer that has it returns
+struct ini_overlay_kv {
+    slice section;                  // all three point into layers[layer]->buf
+    slice key;
+    slice value;
+    int layer;                      // index of the layer it comes from, -1 if no layer has it (any more)
+    int index;                      // into layers[layer]->properties
+};
+
+// Layered configuration (defaults, site, host, overrides, ...) merged into one hash table, so a lookup
+// costs the same however many layers there are. Later layers win, within a layer the later property wins
+// like in ini_get(). Nothing is copied, entries point into the layers' buffers, so the layers have to outlive
+// the overlay. See init_ini_overlay().
+struct ini_overlay {
+    std::vector<ini_parser *> layers;  // lowest priority first
+    ini_vector<ini_overlay_kv> entries;
+    ini_table table;                // section+key -> index into entries
+};
+
+// Identifies the exact source file contents a binary cache was built from, see load_ini_cached()
+struct ini_cache_key {
+    uint64_t size;                  // file size in bytes
+    int64_t mtime;                  // last write time, in whatever unit the OS reports it (ns / 100ns)
+    uint64_t hash;                  // FNV-1a of the file contents, used when only the mtime changed
+};
+
+// Header of a binary cache file. It's followed by section_count ini_cache_section, property_count
+// ini_cache_property, then the string pool (a verbatim copy of the source file) all offsets point into.
+// Fields are native endian, caches are built on the machine that uses them.
+struct ini_cache_header {
+    char magic[4];                  // INI_CACHE_MAGIC
+    uint32_t version;               // INI_CACHE_VERSION, bumped whenever this layout changes
+    ini_cache_key key;              // source file the cache was built from
+    uint32_t section_count;
+    uint32_t property_count;
+    uint32_t pool_offset;           // offset of the string pool from the start of the file
+    uint32_t pool_length;
+    uint32_t line;                  // ini_parser::line after the parse
+    uint32_t section;               // ini_parser::section after the parse, index into the section table
+    uint32_t flags;                 // INI_CACHE_FLAGS of the parse, a cache only serves parsers with the same ones
+};
+
+#define INI_CACHE_MAGIC "INIC"
+#define INI_CACHE_VERSION 2
+#define INI_CACHE_FLAGS (INI_QUOTED_VALUES | INI_VALIDATE_UTF8)  // parse flags that change what's in a cache
+#define INI_CACHE_NIL UINT32_MAX    // section offset of the unnamed section (its name is a nil slice)
+
+struct ini_cache_section {
+    uint32_t offset;                // into the string pool, INI_CACHE_NIL for the unnamed section
+    uint32_t length;
+};
+
+struct ini_cache_property {
+    uint32_t section;               // index into the section table
+    uint32_t key_offset;
+    uint32_t key_length;
+    uint32_t value_offset;
+    uint32_t value_length;
+    uint32_t flags;                 // ini_kv::flags
+};
+
+// Whatever backs the slices of a parser filled by load_ini_cached(), release with free_ini_cached()
+struct ini_cached_file {
+    mapped_file cache;              // the cache file, if it was fresh
+    buffer source;                  // read_entire_file() copy of the source, if it had to be parsed
+    bool hit;                       // properties came from the cache
+};
+
+// One change made through an ini_writer
+struct ini_edit {
+    slice section;
+    slice key;
+    slice value;                    // as it will be written (quoted/escaped if needed), nil = remove the property
+    int order;                      // # of edits made before this one
+};
+
+// Edits to write a parsed file back out with. Everything that isn't edited is written straight out of the
+// parser's buf, comments, blank lines and formatting included: a changed value only replaces the value's
+// bytes, a removed property takes its line(s) with it and a new one goes after the last property of its
+// section (or into a new section at the end). Nothing is applied to the parser itself, parse the new file
+// (or reload_ini() it) to see the edits.
+// The parser must have parsed buf from its start, and not have unescaped anything over it (INI_QUOTED_VALUES
+// with writable set), since the untouched bytes of buf are what gets written.
+struct ini_writer {
+    ini_parser *ini;                // parse of the file being edited, must outlive the writer
+    std::vector<ini_edit> edits;    // in the order they were made, the last edit of a property wins
+    ini_arena strings;              // copies of every edit's strings and the text generated for them
+};
+
+// Outcome of one file of ini_parse_batch()
+struct ini_batch_result {
+    ini_parser ini;                 // parse of the file, slices point into buf
+    buffer buf;                     // file contents (nil-terminated), owned by the batch
+    int read_error;                 // 0, or negative error code like read_entire_file()'s (-1 open, -2 length, -3 alloc, -4 read)
+    int parse_error;                // 0, or what parse_ini() returned (not run if reading failed), ini.error has the
+                                    // details (and ini.errors all of them, with INI_RECOVER in flags)
+};
+
+// Owns the memory behind a batch's results: one arena per worker, so the workers never share an allocator
+// and every small file lands in blocks its worker already has instead of getting its own malloc
+struct ini_batch {
+    std::vector<ini_arena *> arenas;
+};
+
+// One published parse of a file (see ini_publish() and the watcher). Snapshots are never modified once
+// published (their lookup table and section ranges are built up front), so any number of threads can read
+// one at the same time.
+struct ini_snapshot {
+    ini_parser ini;                 // parse of the file, ini.buf is owned by the snapshot
+    int version;                    // 1 for the first successful load, +1 for every reload published after it
+};
+
+// Latest snapshot of a config that one thread replaces (ini_publish()) while any number of threads read it.
+// Readers go through their own ini_reader, which only touches this when a new version is out.
+struct ini_shared {
+    std::shared_ptr<ini_snapshot> snapshot;  // only accessed with std::atomic_load/store
+    std::atomic<int> version{ 0 };           // snapshot->version, stored after snapshot
+};
+
+// One thread's cached reference to an ini_shared's snapshot, e.g. a thread_local. Checking for a newer
+// version is a single load of a cache line that's only written on publish, so readers never write shared
+// memory (no refcount traffic) until the config actually changes. See ini_read().
+struct ini_reader {
+    const ini_shared *shared;
+    std::shared_ptr<ini_snapshot> snapshot;  // keeps the version this thread is reading alive
+    int version;                             // snapshot->version, 0 = nothing cached yet
+};
+
+// Directory holding one or more watched files
+struct ini_watch_dir {
+    std::vector<char> path;         // nil-terminated
+#ifdef _WIN32
+    HANDLE handle;                  // opened for ReadDirectoryChangesW()
+    OVERLAPPED overlapped;          // pending ReadDirectoryChangesW(), signals overlapped.hEvent
+    DWORD changes[4096];            // FILE_NOTIFY_INFORMATION records, has to be DWORD aligned
+#elif defined(__linux__)
+    int wd;                         // inotify watch descriptor
+#endif
+};
+
+struct ini_watch_file {
+    std::vector<char> path;         // nil-terminated
+    int dir;                        // index into ini_watcher::dirs
+    int name;                       // offset of the file name in path
+    std::shared_ptr<ini_snapshot> snapshot;  // latest good parse, only accessed with std::atomic_load/store
+    ini_cache_key key;              // size/mtime when snapshot was loaded, for the polling fallback
+    bool dirty;                     // changed since the last reload, waiting for the debounce to run out
+};
+
+// Background thread that watches a set of .ini files and publishes a new ini_snapshot whenever one
+// changes (inotify on Linux, ReadDirectoryChangesW on Windows, polling mtimes elsewhere).
+// See start_ini_watcher().
+struct ini_watcher {
+    std::vector<ini_watch_dir> dirs;
+    std::vector<ini_watch_file> files;
+    int flags;                      // ini_parser::flags for every parse
+    bool quiet;                     // ini_parser::quiet for every parse
+    int debounce_ms;                // reload once a file has been quiet for this long
+    // Called on the watcher thread after a reload got published, with the snapshot it replaced (nil for
+    // the first load) still alive, so the changes' old_value slices are valid during the call
+    void (*on_reload)(void *user, int file, const ini_snapshot *snapshot, const std::vector<ini_change> *changes);
+    void *user;                     // passed through to on_reload
+    std::thread thread;
+#ifdef _WIN32
+    HANDLE stop;                    // manual reset event that tells the thread to exit
+#else
+    int notify_fd;                  // inotify instance, -1 when polling
+    int wake[2];                    // pipe, writing to it tells the thread to exit
+#endif
+};
+
+void ini_set_trace(const ini_trace *trace);
+const ini_scanner *ini_best_scanner();
+int ini_available_scanners(const ini_scanner **list, int max);
+void init_ini(ini_parser *ini, buffer buf, ini_arena *arena = 0);
+int estimate_ini_properties(const ini_parser *ini);
+int parse_ini(ini_parser *ini);
+int index_ini(ini_parser *ini);
+int parse_ini_indexed(ini_parser *ini);
+int parse_ini_parallel(ini_parser *ini, int thread_count = 0, int min_chunk = INI_PARALLEL_MIN_CHUNK);
+int index_ini_sections(ini_parser *ini);
+int ini_load_section(ini_parser *ini, slice name);
+slice ini_lazy_get(ini_parser *ini, slice section, slice key);
+slice ini_lazy_get(ini_parser *ini, const char *section, const char *key);
+void update_ini_lookup(ini_parser *ini);
+int ini_find(ini_parser *ini, slice section, slice key);
+slice ini_get(ini_parser *ini, slice section, slice key);
+slice ini_get(ini_parser *ini, const char *section, const char *key);
+void update_ini_sorted(ini_parser *ini);
+const ini_kv *ini_sorted_kv(const ini_parser *ini, int i);
+int ini_prefix_range(ini_parser *ini, slice section, slice prefix, int *begin, int *end);
+int ini_key_range(ini_parser *ini, slice section, slice first, slice last, int *begin, int *end);
+int ini_section_prefix_range(ini_parser *ini, slice prefix, int *begin, int *end);
+void group_ini_sections(ini_parser *ini);
+int ini_find_section(ini_parser *ini, slice name);
+int ini_section_range(ini_parser *ini, const char *name, int *begin, int *end);
+int ini_compact_count(const ini_parser *ini);
+slice ini_compact_section(const ini_parser *ini, int i);
+slice ini_compact_key(const ini_parser *ini, int i);
+slice ini_compact_value(const ini_parser *ini, int i);
+int ini_parse_int(slice s, int64_t *value);
+int ini_parse_double(slice s, double *value);
+int ini_parse_bool(slice s, bool *value);
+int ini_parse_duration(slice s, int64_t *nanoseconds);
+int ini_parse_size(slice s, uint64_t *bytes);
+int ini_get_int(ini_parser *ini, const char *section, const char *key, int64_t *value);
+int ini_get_double(ini_parser *ini, const char *section, const char *key, double *value);
+int ini_get_bool(ini_parser *ini, const char *section, const char *key, bool *value);
+int ini_get_duration(ini_parser *ini, const char *section, const char *key, int64_t *nanoseconds);
+int ini_get_size(ini_parser *ini, const char *section, const char *key, uint64_t *bytes);
+void init_ini_stream(ini_stream *stream, ini_arena *arena = 0);
+void free_ini_stream(ini_stream *stream);
+int ini_feed(ini_stream *stream, const char *bytes, int length);
+int ini_finish(ini_stream *stream);
+int reload_ini(ini_parser *old, buffer buf, ini_parser *ini, std::vector<ini_change> *changes, ini_arena *arena = 0);
+void init_ini_overlay(ini_overlay *overlay, ini_parser **layers, int count);
+void free_ini_overlay(ini_overlay *overlay);
+const ini_overlay_kv *ini_overlay_find(const ini_overlay *overlay, slice section, slice key);
+slice ini_overlay_get(const ini_overlay *overlay, slice section, slice key);
+slice ini_overlay_get(const ini_overlay *overlay, const char *section, const char *key);
+void ini_overlay_reload(ini_overlay *overlay, int layer, ini_parser *ini, const std::vector<ini_change> *changes);
+void discard_whitespace(ini_parser *ini);
+void discard_comment(ini_parser *ini);
+int parse_section_header(ini_parser *ini);
+int parse_kv(ini_parser *ini);
+int read_entire_file(const char *filename, buffer *buf);
+int map_entire_file(const char *filename, mapped_file *file);
+void unmap_file(mapped_file *file);
+int read_compressed_file(const char *filename, buffer *buf);
+int ini_load_compressed(const char *filename, ini_stream *stream, int block_size = INI_DECOMPRESS_BLOCK);
+int write_ini_cache(const ini_parser *ini, const char *filename, const ini_cache_key *key);
+int load_ini_cached(const char *filename, const char *cache_filename, ini_parser *ini, ini_cached_file *file,
+    ini_arena *arena = 0);
+void free_ini_cached(ini_cached_file *file);
+void init_ini_writer(ini_writer *writer, ini_parser *ini);
+void free_ini_writer(ini_writer *writer);
+int ini_set(ini_writer *writer, slice section, slice key, slice value);
+int ini_set(ini_writer *writer, const char *section, const char *key, const char *value);
+int ini_remove(ini_writer *writer, slice section, slice key);
+int ini_remove(ini_writer *writer, const char *section, const char *key);
+int ini_write_gather(ini_writer *writer, std::vector<slice> *out);
+int ini_write_file(ini_writer *writer, const char *filename);
+std::shared_ptr<ini_snapshot> ini_watch_snapshot(const ini_watcher *watcher, int file);
+int ini_publish(ini_shared *shared, ini_parser *ini);
+std::shared_ptr<ini_snapshot> ini_shared_snapshot(const ini_shared *shared);
+void init_ini_reader(ini_reader *reader, const ini_shared *shared);
+const ini_snapshot *ini_read(ini_reader *reader);
+slice ini_snapshot_get(const ini_snapshot *snapshot, slice section, slice key);
+slice ini_snapshot_get(const ini_snapshot *snapshot, const char *section, const char *key);
+int start_ini_watcher(ini_watcher *watcher, const char **paths, int count, int debounce_ms = 50);
+void stop_ini_watcher(ini_watcher *watcher);
+int ini_parse_batch(const char **paths, int count, ini_batch_result *results, ini_batch *batch, int flags = 0,
+    int thread_count = 0);
+void free_ini_batch(ini_batch *batch);
+int ini_load_async(const char **paths, int count, ini_batch_result *results, ini_batch *batch, int flags = 0,
+    int depth = 64);
+
+//------------------------------------------------------------------------------
+// Schema
+//------------------------------------------------------------------------------
+
+// Compile-time binding of known section/key names to the members of a struct. Declare the fields once,
+// ini_make_schema() finds a perfect hash for them while compiling, and ini_parse_schema() parses straight
+// into the struct through a visitor: each key costs one hash, one table probe and one compare, and there's
+// no properties vector at all.
+//
+//     struct server_config { int64_t threads; bool verbose; int64_t timeout; slice name; };
+//     static constexpr ini_field server_fields[] = {
+//         INI_FIELD(server_config, "server", "threads", threads),
+//         INI_FIELD(server_config, "server", "verbose", verbose),
+//         INI_FIELD_AS(server_config, "server", "timeout", timeout, INI_TYPE_DURATION),
+//         INI_FIELD(server_config, "", "name", name),
+//     };
+//     static constexpr auto server_schema = ini_make_schema<server_config>(server_fields);
+//     ...
+//     server_config config{};  // members keep these defaults if the file doesn't set them
+//     int err = ini_parse_schema(&ini, server_schema, &config);
+
+// What a member is converted with, see INI_FIELD()
+template <typename M> struct ini_member_type;
+template <> struct ini_member_type<int64_t> { static constexpr int value = INI_TYPE_INT; };
+template <> struct ini_member_type<int> { static constexpr int value = INI_TYPE_INT; };
+template <> struct ini_member_type<uint64_t> { static constexpr int value = INI_TYPE_SIZE; };
+template <> struct ini_member_type<double> { static constexpr int value = INI_TYPE_DOUBLE; };
+template <> struct ini_member_type<float> { static constexpr int value = INI_TYPE_DOUBLE; };
+template <> struct ini_member_type<bool> { static constexpr int value = INI_TYPE_BOOL; };
+template <> struct ini_member_type<slice> { static constexpr int value = INI_TYPE_STRING; };
+
+struct ini_field {
+    const char *section;            // "" for properties before the first [section]
+    const char *key;
+    int type;                       // INI_TYPE_*
+    size_t size;                    // sizeof(member)
+    size_t offset;                  // offsetof(struct, member)
+};
+
+constexpr ini_field ini_make_field(const char *section, const char *key, int type, size_t size, size_t offset)
+{
+    // Evaluated while compiling, so a mismatch is a compile error
+    if (!((type == INI_TYPE_INT && (size == 8 || size == 4)) ||
+          (type == INI_TYPE_DOUBLE && (size == 8 || size == 4)) ||
+          (type == INI_TYPE_BOOL && size == sizeof(bool)) ||
+          ((type == INI_TYPE_DURATION || type == INI_TYPE_SIZE) && size == 8) ||
+          (type == INI_TYPE_STRING && size == sizeof(slice)))) {
+        throw "ini_field: member type doesn't match the value type";
+    }
+    return ini_field{ section, key, type, size, offset };
+}
+
+// Bind [section] key to s.member, converted according to the member's type (int64_t/int, double/float,
+// bool, uint64_t as a size, slice for the raw value)
+#define INI_FIELD(type, section, key, member) \
+    ini_make_field(section, key, ini_member_type<decltype(type::member)>::value, sizeof(type::member), offsetof(type, member))
+// Same, but with an explicit INI_TYPE_* (e.g. INI_TYPE_DURATION for an int64_t of nanoseconds)
+#define INI_FIELD_AS(type, section, key, member, as) \
+    ini_make_field(section, key, as, sizeof(type::member), offsetof(type, member))
+
+constexpr int ini_cstr_length(const char *s)
+{
+    int length = 0;
+    while (s[length]) {
+        length++;
+    }
+    return length;
+}
+
+// FNV-1a over section, then key (like hash_section_key()), with 0xff between them so "ab"/"c" != "a"/"bc"
+constexpr uint32_t ini_schema_hash(const char *section, int section_length, const char *key, int key_length)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < section_length; i++) {
+        hash = (hash ^ (unsigned char)section[i]) * 16777619u;
+    }
+    hash = (hash ^ 0xff) * 16777619u;
+    for (int i = 0; i < key_length; i++) {
+        hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Slot for a key with hash in a bucket with displacement d. The finalizer (murmur3's fmix32) makes every
+// d an independent-looking shot at a free slot
+constexpr uint32_t ini_schema_slot(uint32_t hash, uint32_t d)
+{
+    uint32_t h = hash ^ (d * 0x9e3779b9u);
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+// Smallest power of 2 that's at least 2 * count, so the last buckets placed still find free slots quickly
+constexpr size_t ini_schema_slot_count(size_t count)
+{
+    size_t slots = 2;
+    while (slots < 2 * count) {
+        slots *= 2;
+    }
+    return slots;
+}
+
+template <typename T, size_t N>
+struct ini_schema {
+    static constexpr size_t slot_count = ini_schema_slot_count(N);
+    static constexpr size_t bucket_count = slot_count / 2;
+    ini_field fields[N] = {};
+    int section_lengths[N] = {};
+    int key_lengths[N] = {};
+    uint32_t displacements[bucket_count] = {};  // hash & (bucket_count - 1) -> d for ini_schema_slot()
+    int slots[slot_count] = {};                 // slot & (slot_count - 1) -> index into fields, -1 = none
+};
+
+// Build the perfect hash table for fields, meant to be evaluated at compile time (constexpr variable).
+// Hash and displace (CHD): keys are split into buckets by hash, then buckets are placed biggest first, each
+// one trying displacements until all of its keys land in free slots. Unlike searching for one seed that
+// works for every key at once, this stays fast no matter how many fields there are.
+template <typename T, size_t N>
+constexpr ini_schema<T, N> ini_make_schema(const ini_field (&fields)[N])
+{
+    ini_schema<T, N> schema{};
+    for (size_t i = 0; i < N; i++) {
+        schema.fields[i] = fields[i];
+        schema.section_lengths[i] = ini_cstr_length(fields[i].section);
+        schema.key_lengths[i] = ini_cstr_length(fields[i].key);
+        for (size_t j = 0; j < i; j++) {
+            bool same = schema.section_lengths[i] == schema.section_lengths[j] && schema.key_lengths[i] == schema.key_lengths[j];
+            for (int c = 0; same && c < schema.section_lengths[i]; c++) {
+                same = fields[i].section[c] == fields[j].section[c];
+            }
+            for (int c = 0; same && c < schema.key_lengths[i]; c++) {
+                same = fields[i].key[c] == fields[j].key[c];
+            }
+            if (same) {
+                throw "ini_make_schema: same section and key bound twice";
+            }
+        }
+    }
+
+    const size_t mask = schema.slot_count - 1;
+    const size_t bucket_mask = schema.bucket_count - 1;
+    uint32_t hashes[N] = {};
+    size_t bucket_sizes[schema.bucket_count] = {};
+    size_t biggest = 0;
+    for (size_t i = 0; i < N; i++) {
+        hashes[i] = ini_schema_hash(fields[i].section, schema.section_lengths[i], fields[i].key, schema.key_lengths[i]);
+        size_t size = ++bucket_sizes[hashes[i] & bucket_mask];
+        biggest = size > biggest ? size : biggest;
+    }
+    for (size_t s = 0; s < schema.slot_count; s++) {
+        schema.slots[s] = -1;
+    }
+
+    for (size_t size = biggest; size > 0; size--) {
+        for (size_t b = 0; b < schema.bucket_count; b++) {
+            if (bucket_sizes[b] != size) {
+                continue;
+            }
+            uint32_t d = 0;
+            for (;; d++) {
+                if (d == (1u << 20)) {
+                    throw "ini_make_schema: no perfect hash found";
+                }
+                // Claim slots as we go, and give them back if a later key in the bucket doesn't fit
+                bool fits = true;
+                for (size_t i = 0; i < N && fits; i++) {
+                    if ((hashes[i] & bucket_mask) != b) {
+                        continue;
+                    }
+                    int &slot = schema.slots[ini_schema_slot(hashes[i], d) & mask];
+                    fits = slot < 0;
+                    if (fits) {
+                        slot = (int)i;
+                    }
+                }
+                if (fits) {
+                    break;
+                }
+                for (size_t s = 0; s < schema.slot_count; s++) {
+                    if (schema.slots[s] >= 0 && (hashes[schema.slots[s]] & bucket_mask) == b) {
+                        schema.slots[s] = -1;
+                    }
+                }
+            }
+            schema.displacements[b] = d;
+        }
+    }
+    return schema;
+}
+
+// Untyped part of ini_parse_schema(), see there
+int ini_parse_fields(ini_parser *ini, const ini_field *fields, const int *section_lengths, const int *key_lengths,
+    const uint32_t *displacements, size_t bucket_count, const int *slots, size_t slot_count, void *out);
+
+// Parse the rest of ini->buf straight into out. Keys the schema doesn't know about are skipped, members
+// whose keys don't show up keep whatever out had in them. Nothing is stored in the parser itself.
+// Returns 0 on success, or a negative error code (a parse error, or a value that doesn't convert to its
+// member's type)
+template <typename T, size_t N>
+int ini_parse_schema(ini_parser *ini, const ini_schema<T, N> &schema, T *out)
+{
+    return ini_parse_fields(ini, schema.fields, schema.section_lengths, schema.key_lengths,
+        schema.displacements, schema.bucket_count, schema.slots, schema.slot_count, out);
+}
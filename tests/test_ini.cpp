@@ -0,0 +1,504 @@
+// Regression tests for the library, run by ctest (or ini_test directly). Each test_* function checks one
+// area, CHECK() prints every failed expectation and main() returns non-zero if there were any.
+// Files are written to the working directory, ctest runs this in the build directory.
+
+#include "ini_parser.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+static slice S(const char *s)
+{
+    return slice{ (char *)s, (int)strlen(s) };
+}
+
+static bool slice_equal(slice a, slice b)
+{
+    return a.length == b.length && (!a.length || !memcmp(a.data, b.data, a.length));
+}
+
+static bool equal(slice s, const char *text)
+{
+    return s.length == (int)strlen(text) && (!s.length || !memcmp(s.data, text, s.length));
+}
+
+// Parser over a writable nil terminated copy of text, like read_entire_file() would give
+struct test_ini {
+    std::vector<char> text;
+    ini_parser ini{};
+
+    test_ini(const char *source, int flags = 0) {
+        text.assign(source, source + strlen(source) + 1);
+        init_ini(&ini, buffer{ text.data(), (int)strlen(source) });
+        ini.flags = flags;
+        ini.quiet = true;
+        ini.writable = true;
+    }
+    ~test_ini() {
+        free_arena(&ini.strings);
+    }
+};
+
+static void write_file(const char *filename, const void *data, size_t size)
+{
+    FILE *fs = fopen(filename, "wb");
+    CHECK(fs);
+    if (fs) {
+        CHECK(fwrite(data, 1, size, fs) == size);
+        fclose(fs);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Typed values
+//------------------------------------------------------------------------------
+
+static void test_typed()
+{
+    int64_t i = 0;
+    CHECK(ini_parse_int(S("42"), &i) == 0 && i == 42);
+    CHECK(ini_parse_int(S("-0x10"), &i) == 0 && i == -16);
+    CHECK(ini_parse_int(S("+7"), &i) == 0 && i == 7);
+    CHECK(ini_parse_int(S("+-7"), &i) < 0);
+    CHECK(ini_parse_int(S("9223372036854775808"), &i) < 0);
+    CHECK(ini_parse_int(S("-9223372036854775808"), &i) == 0 && i == INT64_MIN);
+    CHECK(ini_parse_int(S("12abc"), &i) < 0);
+    CHECK(ini_parse_int(S(""), &i) < 0);
+
+    double d = 0;
+    CHECK(ini_parse_double(S("1.5"), &d) == 0 && d == 1.5);
+    CHECK(ini_parse_double(S("+2e3"), &d) == 0 && d == 2000);
+    CHECK(ini_parse_double(S("-0.25"), &d) == 0 && d == -0.25);
+    CHECK(ini_parse_double(S("+-1"), &d) < 0);
+    CHECK(ini_parse_double(S("++1"), &d) < 0);
+    CHECK(ini_parse_double(S("+"), &d) < 0);
+    CHECK(ini_parse_double(S("1.5x"), &d) < 0);
+
+    bool b = false;
+    CHECK(ini_parse_bool(S("YES"), &b) == 0 && b);
+    CHECK(ini_parse_bool(S("off"), &b) == 0 && !b);
+    CHECK(ini_parse_bool(S("2"), &b) < 0);
+
+    int64_t ns = 0;
+    CHECK(ini_parse_duration(S("1h30m"), &ns) == 0 && ns == 5400000000000ll);
+    CHECK(ini_parse_duration(S("1.5s"), &ns) == 0 && ns == 1500000000ll);
+    CHECK(ini_parse_duration(S("250ms"), &ns) == 0 && ns == 250000000ll);
+    CHECK(ini_parse_duration(S("3"), &ns) == 0 && ns == 3000000000ll);
+    CHECK(ini_parse_duration(S("5y"), &ns) < 0);
+
+    uint64_t bytes = 0;
+    CHECK(ini_parse_size(S("4k"), &bytes) == 0 && bytes == 4096);
+    CHECK(ini_parse_size(S("2 MB"), &bytes) == 0 && bytes == 2000000);
+    CHECK(ini_parse_size(S("1GiB"), &bytes) == 0 && bytes == 1073741824ull);
+    CHECK(ini_parse_size(S("12"), &bytes) == 0 && bytes == 12);
+    CHECK(ini_parse_size(S("-1k"), &bytes) < 0);
+
+    test_ini t("[net]\nport=8080\nratio=0.5\ntimeout=2s\nbad=x\n", INI_BUILD_LOOKUP | INI_CACHE_TYPED);
+    CHECK(parse_ini(&t.ini) == 0);
+    CHECK(ini_get_int(&t.ini, "net", "port", &i) == 0 && i == 8080);
+    CHECK(ini_get_int(&t.ini, "net", "port", &i) == 0 && i == 8080);
+    CHECK(ini_get_double(&t.ini, "net", "ratio", &d) == 0 && d == 0.5);
+    CHECK(ini_get_duration(&t.ini, "net", "timeout", &ns) == 0 && ns == 2000000000ll);
+    CHECK(ini_get_int(&t.ini, "net", "bad", &i) < 0);
+    CHECK(ini_get_int(&t.ini, "net", "missing", &i) < 0);
+}
+
+//------------------------------------------------------------------------------
+// Reusing parsers
+//------------------------------------------------------------------------------
+
+static void test_reuse()
+{
+    // Everything the last parse left behind (tables, counts, errors, section) is gone after init_ini()
+    char first[] = "[a]\nx=1\ny=2\n[b]\nbad line\n";
+    char second[] = "z=3\n";
+    ini_parser ini{};
+    init_ini(&ini, buffer{ first, (int)strlen(first) });
+    ini.flags = INI_BUILD_LOOKUP | INI_LAYOUT_SECTIONS | INI_RECOVER;
+    ini.quiet = true;
+    CHECK(parse_ini(&ini) < 0);
+    CHECK(equal(ini_get(&ini, "a", "y"), "2"));
+    init_ini(&ini, buffer{ second, (int)strlen(second) });
+    CHECK(ini.flags == (INI_BUILD_LOOKUP | INI_LAYOUT_SECTIONS | INI_RECOVER));
+    CHECK(ini.error.code == 0 && ini.errors.empty());
+    CHECK(!ini.section.data && ini.section_index == 0);
+    CHECK(ini_find(&ini, S("a"), S("y")) < 0);
+    CHECK(parse_ini(&ini) == 0);
+    CHECK(equal(ini_get(&ini, "", "z"), "3"));
+    CHECK(ini.properties.size() == 1 && ini.sections.size() == 1);
+    CHECK(ini_find(&ini, S("a"), S("x")) < 0);
+
+    // Reloading back and forth between two parsers, each reload reuses the parser before last
+    const char *versions[] = {
+        "[a]\nx=1\ny=2\n[b]\nz=3\n",
+        "[a]\nx=1\ny=20\n[b]\nz=3\n",
+        "[a]\nx=1\ny=20\n[b]\nz=30\nw=4\n",
+        "[a]\nx=1\n[b]\nz=30\nw=4\n",
+    };
+    std::vector<char> texts[4];
+    for (int i = 0; i < 4; i++) {
+        texts[i].assign(versions[i], versions[i] + strlen(versions[i]) + 1);
+    }
+    ini_parser parsers[2]{};
+    init_ini(&parsers[0], buffer{ texts[0].data(), (int)strlen(versions[0]) });
+    parsers[0].flags = INI_BUILD_LOOKUP;
+    CHECK(parse_ini(&parsers[0]) == 0);
+    std::vector<ini_change> changes;
+    for (int i = 1; i < 4; i++) {
+        ini_parser *old = &parsers[(i - 1) % 2];
+        ini_parser *now = &parsers[i % 2];
+        CHECK(reload_ini(old, buffer{ texts[i].data(), (int)strlen(versions[i]) }, now, &changes) == 0);
+        CHECK(changes.size() == 1 || (i == 2 && changes.size() == 2));
+    }
+    ini_parser *last = &parsers[1];
+    CHECK(equal(ini_get(last, "a", "x"), "1"));
+    CHECK(!ini_get(last, "a", "y").data);
+    CHECK(equal(ini_get(last, "b", "z"), "30"));
+    CHECK(equal(ini_get(last, "b", "w"), "4"));
+    CHECK(last->properties.size() == 3);
+}
+
+//------------------------------------------------------------------------------
+// Reload
+//------------------------------------------------------------------------------
+
+// reload_ini() from old_text to new_text gives what parse_ini() of new_text does, errors included
+static void check_reload(const char *old_text, const char *new_text, int flags)
+{
+    test_ini old(old_text, flags);
+    test_ini fresh(new_text, flags);
+    test_ini now(new_text, flags);
+    parse_ini(&old.ini);
+    int want = parse_ini(&fresh.ini);
+    std::vector<ini_change> changes;
+    CHECK(reload_ini(&old.ini, now.ini.buf, &now.ini, &changes) == want);
+    CHECK(now.ini.errors.size() == fresh.ini.errors.size());
+    CHECK(now.ini.error.code == fresh.ini.error.code && now.ini.error.line == fresh.ini.error.line);
+    CHECK(now.ini.properties.size() == fresh.ini.properties.size());
+    CHECK(now.ini.line == fresh.ini.line);
+}
+
+static void test_reload()
+{
+    int flags = INI_BUILD_LOOKUP | INI_RECOVER;
+    // Old errors outside the change are still errors (every line of the old parse, changed or not)
+    check_reload("[a]\nx=1\nbad line\ny=2\nz=3\n", "[a]\nx=1\nbad line\ny=2\nz=4\n", flags);
+    check_reload("[a]\nx=1\nbad line\ny=2\nz=3\n", "[a]\nx=1\ny=2\nz=3\n", flags);
+    // New ones in the change are found
+    check_reload("[a]\nx=1\ny=2\nz=3\n", "[a]\nx=1\ny\nz=3\n", flags);
+    check_reload("[a]\nx=1\ny=2\nz=3\n", "[a]\nx=1\ny=2\nz=3\n[b\n", flags);
+    check_reload("[a]\nx=1\ny=2\nz=3\n", "[a]\nx=1\ny\nz=3\n", INI_BUILD_LOOKUP);
+}
+
+//------------------------------------------------------------------------------
+// Quoted values
+//------------------------------------------------------------------------------
+
+static void test_quoted()
+{
+    // A line with an unknown escape is rejected before any of it gets unescaped over buf
+    test_ini t("k=\"a\\tb\\q\"\nj=\"x\\ny\"\n", INI_QUOTED_VALUES | INI_RECOVER);
+    CHECK(parse_ini(&t.ini) < 0);
+    CHECK(t.ini.error.code == INI_ERROR_ESCAPE);
+    CHECK(equal(t.ini.error.text, "k=\"a\\tb\\q\""));
+    CHECK(t.ini.properties.size() == 1);
+    if (t.ini.properties.size() == 1) {
+        CHECK(equal(t.ini.properties[0].value, "x\ny"));
+        CHECK(t.ini.properties[0].flags == (INI_VALUE_QUOTED | INI_VALUE_IN_PLACE));
+    }
+
+    // Not writable: the value is copied out and buf stays as it was
+    test_ini copy("k=\"a\\\"b\" ; comment\n", INI_QUOTED_VALUES);
+    copy.ini.writable = false;
+    CHECK(parse_ini(&copy.ini) == 0);
+    CHECK(copy.ini.properties.size() == 1);
+    if (copy.ini.properties.size() == 1) {
+        CHECK(equal(copy.ini.properties[0].value, "a\"b"));
+        CHECK(copy.ini.properties[0].flags == (INI_VALUE_QUOTED | INI_VALUE_SPILLED));
+    }
+    CHECK(!strcmp(copy.text.data(), "k=\"a\\\"b\" ; comment\n"));
+}
+
+//------------------------------------------------------------------------------
+// Parallel parse
+//------------------------------------------------------------------------------
+
+static void test_parallel()
+{
+    // Escaped values in a writable buffer end up unescaped in place like with parse_ini(), so the compact
+    // layout (offsets into buf) can hold them
+    std::string text;
+    for (int i = 0; i < 2000; i++) {
+        text += "[s" + std::to_string(i) + "]\nk=\"a\\tb\"\nplain=" + std::to_string(i) + "\n";
+    }
+    int flags = INI_QUOTED_VALUES | INI_LAYOUT_COMPACT;
+    test_ini serial(text.c_str(), flags);
+    test_ini parallel(text.c_str(), flags);
+    CHECK(parse_ini(&serial.ini) == 0);
+    CHECK(parse_ini_parallel(&parallel.ini, 4, 64) == 0);
+    CHECK(parallel.ini.properties.size() == serial.ini.properties.size());
+    CHECK(ini_compact_count(&parallel.ini) == ini_compact_count(&serial.ini));
+    CHECK(parallel.text == serial.text);
+    for (size_t i = 0; i < parallel.ini.properties.size() && i < serial.ini.properties.size(); i++) {
+        const ini_kv &a = serial.ini.properties[i];
+        const ini_kv &b = parallel.ini.properties[i];
+        CHECK(b.flags == a.flags);
+        CHECK(b.value.data - parallel.text.data() == a.value.data - serial.text.data());
+        CHECK(b.value.length == a.value.length);
+    }
+    for (int i = 0; i < ini_compact_count(&parallel.ini); i += 2) {
+        CHECK(equal(ini_compact_value(&parallel.ini, i), "a\tb"));
+    }
+
+    // A chunk that fails is parsed again serially, over bytes no worker has written to
+    test_ini failing((text + "k=\"bad\\q\"\n" + text).c_str(), INI_QUOTED_VALUES | INI_RECOVER);
+    test_ini reference((text + "k=\"bad\\q\"\n" + text).c_str(), INI_QUOTED_VALUES | INI_RECOVER);
+    CHECK(parse_ini_parallel(&failing.ini, 4, 64) < 0);
+    CHECK(parse_ini(&reference.ini) < 0);
+    CHECK(failing.ini.errors.size() == 1 && reference.ini.errors.size() == 1);
+    CHECK(failing.ini.properties.size() == reference.ini.properties.size());
+    CHECK(failing.text == reference.text);
+}
+
+//------------------------------------------------------------------------------
+// Streaming
+//------------------------------------------------------------------------------
+
+// Feed text in pieces of piece bytes, returns what ini_finish() does
+static int feed_in_pieces(ini_stream *stream, const std::string &text, size_t piece)
+{
+    for (size_t at = 0; at < text.size(); at += piece) {
+        size_t n = text.size() - at < piece ? text.size() - at : piece;
+        int err = ini_feed(stream, text.data() + at, (int)n);
+        if (err < 0) {
+            return err;
+        }
+    }
+    return ini_finish(stream);
+}
+
+static void test_stream()
+{
+    // Any piece size gives what parse_ini() does
+    const std::string text = "\xef\xbb\xbftop=1\r\n[a]\nk = v ; c\n\n[b]\nq=\"x\\ty\" ; c\nlast=2";
+    test_ini reference(text.c_str(), INI_QUOTED_VALUES);
+    CHECK(parse_ini(&reference.ini) == 0);
+    for (size_t piece = 1; piece <= text.size(); piece++) {
+        ini_stream stream{};
+        init_ini_stream(&stream);
+        stream.ini.flags = INI_QUOTED_VALUES;
+        CHECK(feed_in_pieces(&stream, text, piece) == 0);
+        CHECK(stream.ini.properties.size() == reference.ini.properties.size());
+        for (size_t i = 0; i < stream.ini.properties.size() && i < reference.ini.properties.size(); i++) {
+            const ini_kv &a = reference.ini.properties[i];
+            const ini_kv &b = stream.ini.properties[i];
+            CHECK(slice_equal(a.section, b.section) && slice_equal(a.key, b.key) && slice_equal(a.value, b.value));
+        }
+        CHECK(stream.ini.line == reference.ini.line);
+        free_ini_stream(&stream);
+    }
+
+    // A long line coming in small pieces is only parsed once it's complete (this takes seconds if every
+    // piece parses the whole line again)
+    std::string line = "[s]\nk=" + std::string(1 << 20, 'x') + "\nz=1\n";
+    ini_stream stream{};
+    init_ini_stream(&stream);
+    CHECK(feed_in_pieces(&stream, line, 16) == 0);
+    CHECK(stream.ini.properties.size() == 2);
+    if (stream.ini.properties.size() == 2) {
+        CHECK(stream.ini.properties[0].value.length == 1 << 20);
+        CHECK(equal(stream.ini.properties[1].value, "1"));
+    }
+    free_ini_stream(&stream);
+
+    // The fed bytes are the caller's, unescaping never writes to them
+    const std::string quoted = "k=\"a\\nb\"\nj=\"c\\td\"\n";
+    std::vector<char> bytes(quoted.begin(), quoted.end());
+    stream = ini_stream{};
+    init_ini_stream(&stream);
+    stream.ini.flags = INI_QUOTED_VALUES;
+    stream.ini.writable = true;
+    CHECK(ini_feed(&stream, bytes.data(), (int)bytes.size()) == 0);
+    CHECK(ini_finish(&stream) == 0);
+    CHECK(std::string(bytes.begin(), bytes.end()) == quoted);
+    CHECK(stream.ini.properties.size() == 2);
+    if (stream.ini.properties.size() == 2) {
+        CHECK(equal(stream.ini.properties[0].value, "a\nb"));
+        CHECK(equal(stream.ini.properties[1].value, "c\td"));
+    }
+    free_ini_stream(&stream);
+}
+
+//------------------------------------------------------------------------------
+// Writer
+//------------------------------------------------------------------------------
+
+static std::string write_to_string(ini_writer *writer)
+{
+    std::vector<slice> out;
+    if (ini_write_gather(writer, &out) < 0) {
+        return "<error>";
+    }
+    std::string text;
+    for (slice s : out) {
+        text.append(s.data, s.length);
+    }
+    return text;
+}
+
+static void test_writer()
+{
+    test_ini t("; settings\n[a]\nk=1\n; keep\nold=x\n\n[b]\nz=2");
+    CHECK(parse_ini(&t.ini) == 0);
+
+    ini_writer writer{};
+    init_ini_writer(&writer, &t.ini);
+    CHECK(ini_set(&writer, "a", "k", "22") == 0);
+    CHECK(ini_set(&writer, "a", "new", "y") == 0);
+    CHECK(ini_remove(&writer, "a", "old") == 0);
+    CHECK(ini_set(&writer, "c", "q", "3") == 0);
+    CHECK(ini_set(&writer, "a", "bad\nkey", "1") < 0);
+    CHECK(write_to_string(&writer) == "; settings\n[a]\nk=22\n; keep\nnew=y\n\n[b]\nz=2\n\n[c]\nq=3\n");
+    free_ini_writer(&writer);
+
+    // Nothing edited is the file itself
+    init_ini_writer(&writer, &t.ini);
+    CHECK(write_to_string(&writer) == t.text.data());
+    free_ini_writer(&writer);
+
+    // Through a file, and back through the parser
+    write_file("ini_test_writer.ini", t.text.data(), t.text.size() - 1);
+    init_ini_writer(&writer, &t.ini);
+    CHECK(ini_set(&writer, "b", "z", "with space") == 0);
+    CHECK(ini_write_file(&writer, "ini_test_writer.ini") == 0);
+    free_ini_writer(&writer);
+    buffer buf{};
+    CHECK(read_entire_file("ini_test_writer.ini", &buf) == 0);
+    ini_parser ini{};
+    init_ini(&ini, buf);
+    ini.flags = INI_BUILD_LOOKUP;
+    CHECK(parse_ini(&ini) == 0);
+    CHECK(equal(ini_get(&ini, "b", "z"), "with space"));
+    CHECK(equal(ini_get(&ini, "a", "k"), "1"));
+    free(buf.data);
+    remove("ini_test_writer.ini");
+}
+
+//------------------------------------------------------------------------------
+// Binary cache
+//------------------------------------------------------------------------------
+
+static void test_cache()
+{
+    const char text[] = "top=1\n[a]\nk=\"x\\ty\"\n[b]\nz=2\n";
+    write_file("ini_test_cache.ini", text, sizeof(text) - 1);
+    remove("ini_test_cache.bin");
+
+    // Miss, then a hit with the same properties, flags included
+    for (int pass = 0; pass < 2; pass++) {
+        ini_parser ini{};
+        ini.flags = INI_QUOTED_VALUES | INI_BUILD_LOOKUP;
+        ini.quiet = true;
+        ini_cached_file file{};
+        CHECK(load_ini_cached("ini_test_cache.ini", "ini_test_cache.bin", &ini, &file) == 0);
+        CHECK(file.hit == (pass == 1));
+        CHECK(ini.properties.size() == 3);
+        CHECK(equal(ini_get(&ini, "", "top"), "1"));
+        CHECK(equal(ini_get(&ini, "a", "k"), "x\ty"));
+        CHECK(equal(ini_get(&ini, "b", "z"), "2"));
+        int k = ini_find(&ini, S("a"), S("k"));
+        CHECK(k >= 0 && ini.properties[k].flags == (INI_VALUE_QUOTED | INI_VALUE_IN_PLACE));
+        CHECK(equal(ini.section, "b"));
+        CHECK(ini.line == 6);
+
+        // The unescaped value can't be written back, from a cache or not
+        ini_writer writer{};
+        init_ini_writer(&writer, &ini);
+        std::vector<slice> out;
+        CHECK(ini_write_gather(&writer, &out) < 0);
+        free_ini_writer(&writer);
+        free_ini_cached(&file);
+        free_arena(&ini.strings);
+    }
+
+    // A cache parsed with other flags doesn't count
+    for (int pass = 0; pass < 2; pass++) {
+        ini_parser ini{};
+        ini.flags = INI_BUILD_LOOKUP;
+        ini.quiet = true;
+        ini_cached_file file{};
+        CHECK(load_ini_cached("ini_test_cache.ini", "ini_test_cache.bin", &ini, &file) == 0);
+        CHECK(file.hit == (pass == 1));
+        CHECK(equal(ini_get(&ini, "a", "k"), "\"x\\ty\""));
+        free_ini_cached(&file);
+        free_arena(&ini.strings);
+    }
+    remove("ini_test_cache.ini");
+    remove("ini_test_cache.bin");
+}
+
+//------------------------------------------------------------------------------
+// Compressed files
+//------------------------------------------------------------------------------
+
+static void test_compressed()
+{
+    // gzip -c of "[a]\nk=v\n"
+    unsigned char gz[] = {
+        0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x8b, 0x4e, 0x8c, 0xe5, 0xca, 0xb6,
+        0x2d, 0xe3, 0x02, 0x00, 0x8f, 0x45, 0x2b, 0xe3, 0x08, 0x00, 0x00, 0x00,
+    };
+    buffer buf{};
+    write_file("ini_test.ini.gz", gz, sizeof(gz));
+#ifdef INI_ZLIB
+    CHECK(read_compressed_file("ini_test.ini.gz", &buf) == 0);
+    CHECK(buf.length == 8 && !memcmp(buf.data, "[a]\nk=v\n", 9));
+    free(buf.data);
+    buf = buffer{};
+#endif
+
+    // The ISIZE trailer is only a hint, absurd ones (4 GiB here, 2 GiB next) mustn't be allocated or
+    // hang the decoder. zlib then rejects the file for not matching its trailer.
+    gz[sizeof(gz) - 4] = gz[sizeof(gz) - 3] = gz[sizeof(gz) - 2] = gz[sizeof(gz) - 1] = 0xff;
+    write_file("ini_test.ini.gz", gz, sizeof(gz));
+    CHECK(read_compressed_file("ini_test.ini.gz", &buf) < 0);
+    gz[sizeof(gz) - 1] = 0x7f;
+    write_file("ini_test.ini.gz", gz, sizeof(gz));
+    CHECK(read_compressed_file("ini_test.ini.gz", &buf) < 0);
+
+    // Truncated
+    write_file("ini_test.ini.gz", gz, sizeof(gz) - 12);
+    CHECK(read_compressed_file("ini_test.ini.gz", &buf) < 0);
+    remove("ini_test.ini.gz");
+}
+
+int main()
+{
+    test_typed();
+    test_reuse();
+    test_reload();
+    test_quoted();
+    test_parallel();
+    test_stream();
+    test_writer();
+    test_cache();
+    test_compressed();
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("all tests passed\n");
+    return 0;
+}